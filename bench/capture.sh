@@ -0,0 +1,14 @@
+#!/bin/sh
+# Captures bench/corpus.txt: the answers of the bundled cmds to a handful of
+# queries, with find.py looking through the tree given (/usr/share by default)
+# instead of the home directory.
+
+cd "$(dirname "$0")/.." || exit 1
+scripts=config/lighthouse/scripts
+tree=${1:-/usr/share}
+
+for query in doc py lib conf man icon font share locale gtk; do
+  HOME=$tree python2 $scripts/find.py "$query" --number_of_output 40 --term urvxt
+  python3 $scripts/basic.py "$query" --term urvxt
+  echo "$query" | bash config/lighthouse/cmd
+done | tr -d '\n' > bench/corpus.txt
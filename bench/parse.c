@@ -0,0 +1,77 @@
+/** @file parse.c
+ *
+ *  @brief Times parse_result_text() over a corpus of cmd output, see
+ *         `make bench` and capture.sh.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "results.h"
+
+/* @brief Bytes parsed per run, the corpus is parsed over and over. */
+#define BYTES_PER_RUN     (256 * 1024 * 1024)
+
+/* @brief Runs timed, the best one is reported. */
+#define RUNS              5
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s corpus [top_k]\n", argv[0]);
+    return 1;
+  }
+  uint32_t top_k = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+
+  FILE *file = fopen(argv[1], "rb");
+  if (!file) {
+    fprintf(stderr, "Couldn't open %s.\n", argv[1]);
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  size_t length = ftell(file);
+  rewind(file);
+  char *corpus = malloc(length + 1);
+  char *text = malloc(length + 1);
+  if (!corpus || !text || fread(corpus, 1, length, file) != length) {
+    fprintf(stderr, "Couldn't read %s.\n", argv[1]);
+    return 1;
+  }
+  fclose(file);
+  corpus[length] = '\0';
+
+  uint32_t iterations = BYTES_PER_RUN / length + 1;
+  uint32_t count = 0;
+  double best = 0;
+  uint32_t run, i;
+  for (run = 0; run < RUNS; run++) {
+    double elapsed = 0;
+    for (i = 0; i < iterations; i++) {
+      /* Parsing is in place, every iteration gets a fresh copy. */
+      memcpy(text, corpus, length + 1);
+      arena_t *arena = arena_new(length / 2);
+      result_t *results;
+      double start = seconds();
+      count = parse_result_text(text, length, top_k, &results, arena);
+      elapsed += seconds() - start;
+      arena_free(arena);
+    }
+    double rate = (double)length * iterations / elapsed / 1e9;
+    if (rate > best) {
+      best = rate;
+    }
+  }
+  printf("%s: %zu bytes, %u results, %.2f GB/s (best of %u runs)\n", argv[1], length, count, best, RUNS);
+  free(corpus);
+  free(text);
+  return 0;
+}
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Runs a script that takes the query as its last argument (see scripts/) from
+an interpreter that already loaded it, so the imports of the script aren't
+paid on every query.
+
+    zygote.py <script> [arguments...]
+
+The zygote speaks the tagged protocol with lighthouse.  Each query forks a
+child of the warmed interpreter, in a process group of its own, that runs the
+script as if it was started with the query as its last argument and answers
+with what it printed.  A cancelled query has its whole group killed.
+"""
+import os
+import signal
+import sys
+import traceback
+
+try:
+    from StringIO import StringIO
+except ImportError:
+    from io import StringIO
+
+
+def interpreter(script):
+    """
+    The interpreter asked for by the shebang of the script, if any.
+    """
+    with open(script) as f:
+        line = f.readline()
+    if not line.startswith("#!"):
+        return None
+    return line[2:].split()
+
+
+def write_all(data):
+    if not isinstance(data, bytes):
+        data = data.encode("utf-8")
+    while data:
+        data = data[os.write(1, data):]
+
+
+def run_query(code, script, args, generation, query):
+    """
+    Runs the script on a query in the child, never returns.
+    """
+    os.setpgid(0, 0)
+    signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+    signal.signal(signal.SIGTERM, signal.SIG_DFL)
+    sys.argv = [script] + args + [query]
+    out = StringIO()
+    sys.stdout = out
+    try:
+        exec(code, {"__name__": "__main__", "__file__": script})
+    except SystemExit:
+        pass
+    except Exception:
+        traceback.print_exc()
+    results = out.getvalue().replace("\n", " ")
+    try:
+        write_all("results %s %s\n" % (generation, results))
+    finally:
+        os._exit(0)
+
+
+def kill_group(pid):
+    try:
+        os.killpg(pid, signal.SIGTERM)
+    except OSError:
+        pass
+
+
+def main():
+    script = os.path.abspath(os.path.expanduser(sys.argv[1]))
+    args = sys.argv[2:]
+
+    # The script has to run under the interpreter it was written for.
+    wanted = interpreter(script)
+    if wanted and not os.environ.get("LIGHTHOUSE_ZYGOTE"):
+        os.environ["LIGHTHOUSE_ZYGOTE"] = wanted[0]
+        try:
+            os.execvp(wanted[0], wanted + [os.path.abspath(__file__)] + sys.argv[1:])
+        except OSError:
+            pass
+
+    with open(script) as f:
+        code = compile(f.read(), script, "exec")
+    # Warm up: the module level of the script runs once, its imports stay
+    # in sys.modules for every child.
+    exec(code, {"__name__": "__lighthouse_zygote__", "__file__": script})
+
+    # Children are reaped by the kernel.
+    children = {}
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+
+    def stop(*_):
+        for pid in children.values():
+            kill_group(pid)
+        os._exit(0)
+    signal.signal(signal.SIGTERM, stop)
+
+    for line in iter(sys.stdin.readline, ""):
+        parts = line.rstrip("\n").split(" ", 2)
+        if len(parts) < 2:
+            continue
+        if parts[0] == "cancel":
+            pid = children.pop(parts[1], None)
+            if pid:
+                kill_group(pid)
+        elif parts[0] == "query":
+            query = parts[2] if len(parts) > 2 else ""
+            pid = os.fork()
+            if pid == 0:
+                run_query(code, script, args, parts[1], query)
+            children[parts[1]] = pid
+    stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+/** @file arena.c
+ *
+ *  @brief This file contains the arena result sets are allocated from.
+ */
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+/* @brief Alignment of every allocation. */
+#define ARENA_ALIGN       16
+/* @brief Smallest block allocated. */
+#define ARENA_MIN_BLOCK   4096
+
+#define align_up(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define max(a,b) ((a) > (b) ? (a) : (b))
+
+/* @brief Where the usable memory of a block starts. */
+#define block_data(block) ((char *)(block) + align_up(sizeof(arena_block_t)))
+
+static arena_block_t *new_block(size_t size) {
+  arena_block_t *block = malloc(align_up(sizeof(arena_block_t)) + size);
+  if (!block) {
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+arena_t *arena_new(size_t size) {
+  arena_t *arena = malloc(sizeof(arena_t));
+  if (!arena) {
+    return NULL;
+  }
+  arena->adopted = NULL;
+  arena->blocks = new_block(max(align_up(size), ARENA_MIN_BLOCK));
+  if (!arena->blocks) {
+    free(arena);
+    return NULL;
+  }
+  return arena;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+  size = align_up(size);
+  arena_block_t *block = arena->blocks;
+  if (block->size - block->used < size) {
+    /* Grow geometrically so a badly sized arena still takes few blocks. */
+    block = new_block(max(size, block->size * 2));
+    if (!block) {
+      return NULL;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  void *memory = block_data(block) + block->used;
+  block->used += size;
+  return memory;
+}
+
+int32_t arena_adopt(arena_t *arena, void *buf) {
+  return arena_adopt_mapping(arena, buf, 0);
+}
+
+int32_t arena_adopt_mapping(arena_t *arena, void *addr, size_t size) {
+  arena_adopted_t *adopted = arena_alloc(arena, sizeof(arena_adopted_t));
+  if (!adopted) {
+    return -1;
+  }
+  adopted->buf = addr;
+  adopted->size = size;
+  adopted->next = arena->adopted;
+  arena->adopted = adopted;
+  return 0;
+}
+
+void arena_absorb(arena_t *arena, arena_t *other) {
+  /* The blocks go behind the newest one, which allocations still come from. */
+  arena_block_t *last_block = other->blocks;
+  while (last_block->next) {
+    last_block = last_block->next;
+  }
+  last_block->next = arena->blocks->next;
+  arena->blocks->next = other->blocks;
+
+  if (other->adopted) {
+    arena_adopted_t *last_adopted = other->adopted;
+    while (last_adopted->next) {
+      last_adopted = last_adopted->next;
+    }
+    last_adopted->next = arena->adopted;
+    arena->adopted = other->adopted;
+  }
+  free(other);
+}
+
+void arena_free(arena_t *arena) {
+  if (!arena) {
+    return;
+  }
+  /* The adopted list lives in the blocks, walk it first. */
+  arena_adopted_t *adopted;
+  for (adopted = arena->adopted; adopted; adopted = adopted->next) {
+    if (adopted->size) {
+      munmap(adopted->buf, adopted->size);
+    } else {
+      free(adopted->buf);
+    }
+  }
+  while (arena->blocks) {
+    arena_block_t *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+  free(arena);
+}
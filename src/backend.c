@@ -0,0 +1,1140 @@
+/** @file backend.c
+ *
+ *  @brief This file contains the logic that fans queries out to every
+ *         configured cmd and merges their results.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wordexp.h>
+
+#include "backend.h"
+#include "child.h"
+#include "describe.h"
+#include "display.h"
+#include "filter.h"
+#include "loop.h"
+
+/* @brief Backoff before restarting a cmd that exited, in ms.  It doubles
+ *        with every restart the cmd doesn't respond in between. */
+#define RESTART_DELAY     100
+#define RESTART_DELAY_MAX 10000
+
+/* @brief Restarts in a row without a response before a cmd is given up on. */
+#define MAX_RESTARTS      8
+
+/* @brief How long cmds get to exit once terminated, in ms. */
+#define EXIT_GRACE        1000
+
+static backend_t backends[MAX_BACKENDS];
+static uint32_t backend_count;
+static struct result_params *draw_params;
+static char *current_query;
+static char *previous_query; /* What current_query was before the last key. */
+static char **spawn_args;    /* Extra arguments, for restarts. */
+
+/* @brief A script, running or terminated but not reaped yet. */
+typedef struct {
+  pid_t pid;
+  uint64_t kill_at;           /* When it gets SIGKILL, 0 while it runs. */
+} job_t;
+
+static job_t jobs[MAX_JOBS];
+static uint32_t job_count;
+static int32_t kill_timer = -1; /* For the first terminated script due. */
+
+/* @brief Where a result of global.results came from, and its hashes. */
+typedef struct {
+  uint32_t backend;
+  uint32_t index;             /* Among the results of the backend. */
+  result_hash_t hash;
+} source_t;
+
+static source_t *sources;     /* Of each of global.results. */
+static uint32_t source_count;
+static uint32_t merged_end[MAX_BACKENDS]; /* Past the last result of each. */
+static struct {
+  backend_t *backend;         /* NULL if the highlight stays where it is. */
+  uint32_t index;
+} pending_highlight;          /* Set by backend_set_highlight(). */
+
+static void request_pages(void);
+static int32_t script_start(backend_t *backend);
+static void script_stop(backend_t *backend);
+
+/* @brief Notes where a result of global.results came from.
+ *
+ * @param to The entry to be populated.
+ * @param backend The index of the backend.
+ * @param index The index of the result among those of the backend.
+ * @return Void.
+ */
+static void set_source(source_t *to, uint32_t backend, uint32_t index) {
+  result_set_t *set = &backends[backend].set;
+  to->backend = backend;
+  to->index = index;
+  if (set->hashes) {
+    to->hash = set->hashes[index];
+  } else {
+    result_hash(&set->results[index], &to->hash);
+  }
+}
+
+/* @brief Finds where the highlighted result went in newly merged results:
+ *        the same result if it's still there, else one with the same action.
+ *
+ * @param merged The newly merged results.
+ * @param count The number of them.
+ * @param highlight A reference to be populated with the index.
+ * @return 0 if it was found, else -1.
+ */
+static int32_t follow_highlight(const source_t *merged, uint32_t count, uint32_t *highlight) {
+  if (!sources || global.result_highlight >= source_count || !sources[global.result_highlight].hash.action) {
+    return -1;
+  }
+  const result_hash_t *hash = &sources[global.result_highlight].hash;
+  uint32_t i, found = count;
+  for (i = 0; i < count; i++) {
+    if (merged[i].hash.content == hash->content) {
+      *highlight = i;
+      return 0;
+    }
+    if (found == count && merged[i].hash.action == hash->action) {
+      found = i;
+    }
+  }
+  if (found == count) {
+    return -1;
+  }
+  *highlight = found;
+  return 0;
+}
+
+/* @brief Checks whether newly merged results are the ones shown already. */
+static int32_t same_results(const source_t *merged, uint32_t count) {
+  if (!sources || count != source_count) {
+    return 0;
+  }
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    if (merged[i].hash.content != sources[i].hash.content) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* @brief Rebuilds global.results from the results of every backend, in
+ *        configuration order, and draws them.
+ *
+ * The results of backends with top_k set come sorted by score, they're
+ * merged by score (ties going in configuration order) where the first of
+ * these backends is.
+ *
+ * The merged results are reconciled with those shown by their hashes: the
+ * highlight stays on its result (or at least its action) wherever it went,
+ * and nothing is drawn if neither the results nor the highlight changed.
+ * draw_result_text() draws the lines that did change only.
+ *
+ * @return Void.
+ */
+static void merge_results(void) {
+  uint32_t i, j, count = 0;
+  for (i = 0; i < backend_count; i++) {
+    result_set_hash(&backends[i].set);
+    count += backends[i].set.count;
+  }
+
+  result_t *results = calloc(count ? count : 1, sizeof(result_t));
+  source_t *merged_sources = malloc((count ? count : 1) * sizeof(source_t));
+  if (!results || !merged_sources) {
+    fprintf(stderr, "Couldn't allocate %u merged results.\n", count);
+    free(results);
+    free(merged_sources);
+    return;
+  }
+  uint32_t merged = 0;
+  int32_t scored_merged = 0;
+  for (i = 0; i < backend_count; i++) {
+    if (!backends[i].settings->top_k) {
+      memcpy(&results[merged], backends[i].set.results, backends[i].set.count * sizeof(result_t));
+      for (j = 0; j < backends[i].set.count; j++) {
+        set_source(&merged_sources[merged++], i, j);
+      }
+      merged_end[i] = merged;
+      continue;
+    }
+    if (scored_merged) {
+      continue;
+    }
+    uint32_t heads[MAX_BACKENDS] = { 0 };
+    while (1) {
+      int32_t best = -1;
+      for (j = i; j < backend_count; j++) {
+        if (!backends[j].settings->top_k || heads[j] == backends[j].set.count) {
+          continue;
+        }
+        if (best < 0 || backends[j].set.results[heads[j]].score > backends[best].set.results[heads[best]].score) {
+          best = j;
+        }
+      }
+      if (best < 0) {
+        break;
+      }
+      results[merged] = backends[best].set.results[heads[best]];
+      set_source(&merged_sources[merged++], best, heads[best]++);
+      merged_end[best] = merged;
+    }
+    scored_merged = 1;
+  }
+
+  uint32_t highlight = global.result_highlight;
+  if (pending_highlight.backend) {
+    uint32_t backend = pending_highlight.backend - backends;
+    for (i = 0; i < count; i++) {
+      if (merged_sources[i].backend == backend && merged_sources[i].index == pending_highlight.index) {
+        highlight = i;
+        break;
+      }
+    }
+    pending_highlight.backend = NULL;
+  } else {
+    follow_highlight(merged_sources, count, &highlight);
+  }
+  int32_t unchanged = highlight == global.result_highlight && same_results(merged_sources, count);
+
+  /* The results point into the sets of the backends, which may be new
+   * even if they hold the same results. */
+  free(global.results);
+  global.results = results;
+  global.result_count = count;
+  global.result_highlight = highlight;
+  free(sources);
+  sources = merged_sources;
+  source_count = count;
+  debug("Merged %u results.\n", count);
+
+  if (unchanged) {
+    debug("Nothing changed, not drawing.\n");
+  } else if (global.result_count) {
+    draw_result_text(draw_params->connection, draw_params->window, draw_params->cr, draw_params->cr_surface, global.results);
+  } else {
+    /* If no result found, just draw an empty window. */
+    uint32_t values[] = { settings.width, settings.height };
+    xcb_configure_window (draw_params->connection, draw_params->window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+    cairo_xcb_surface_set_size(draw_params->cr_surface, settings.width, settings.height);
+    draw_invalidate();
+  }
+  request_pages();
+}
+
+/* @brief Drops the results a backend currently holds (without merging). */
+static void clear_results(backend_t *backend) {
+  result_set_free(&backend->set);
+}
+
+/* @brief Replaces the results a backend holds (without merging). */
+static void replace_results(backend_t *backend, result_set_t *set) {
+  clear_results(backend);
+  backend->set = *set;
+}
+
+/* @brief Drops the results of a backend that can't match the query, in
+ *        place and keeping their order, until the cmd answers for real.
+ *
+ * @param backend The backend.
+ * @param query The query, an extension of the one the results answer.
+ * @return 1 if results were dropped, else 0.
+ */
+static int32_t narrow_results(backend_t *backend, const char *query) {
+  uint32_t query_length = strlen(query);
+  uint32_t i, kept = 0;
+  for (i = 0; i < backend->set.count; i++) {
+    char *text = backend->set.results[i].text;
+    int32_t score;
+    if (text && !filter_score(text, strlen(text), query, query_length, &score)) {
+      if (backend->set.hashes) {
+        backend->set.hashes[kept] = backend->set.hashes[i];
+      }
+      backend->set.results[kept++] = backend->set.results[i];
+    }
+  }
+  if (kept == backend->set.count) {
+    return 0;
+  }
+  backend->set.count = kept;
+  return 1;
+}
+
+static void handle_writable(uint32_t events, void *args);
+
+/* @brief Writes what the pipe of a backend takes of its buffered messages,
+ *        and waits for it to take the rest.
+ *
+ * @param backend The backend.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t backend_flush(backend_t *backend) {
+  ssize_t left = writer_flush(&backend->writer, backend->to_fd);
+  if (left < 0) {
+    writer_clear(&backend->writer);
+  }
+  if (left > 0 && !backend->write_blocked) {
+    backend->write_blocked = !loop_add(backend->to_fd, EPOLLOUT, handle_writable, backend);
+  } else if (left <= 0 && backend->write_blocked) {
+    loop_remove(backend->to_fd);
+    backend->write_blocked = 0;
+  }
+  return left < 0 ? -1 : 0;
+}
+
+/* @brief Writes the current query to a backend.
+ *
+ * While the cmd doesn't read what it was sent, the query is only marked as
+ * pending: whatever the query is once the pipe drains is written then, so
+ * the queries typed meanwhile never pile up.
+ *
+ * @param backend The backend to write to.
+ * @return Void.
+ */
+static void backend_send(backend_t *backend) {
+  int32_t script = backend_runs_script(backend);
+  if ((backend->to_fd == -1 && !backend->plugin.handle && !script) || !current_query) {
+    return;
+  }
+  if (writer_pending(&backend->writer)) {
+    backend->send_pending = 1;
+    return;
+  }
+  backend->send_pending = 0;
+
+  int32_t ret = 0;
+  if (script) {
+    /* The run answering the superseded query is of no use anymore. */
+    script_stop(backend);
+    if (job_count >= settings.max_jobs) {
+      /* Started once another script is reaped. */
+      backend->send_pending = 1;
+      return;
+    }
+    backend->generation++;
+    ret = script_start(backend);
+  } else if (backend->plugin.handle) {
+    if (backend->generation) {
+      plugin_cancel(&backend->plugin, backend->generation);
+    }
+    backend->generation++;
+    plugin_query(&backend->plugin, backend->generation, current_query);
+  } else {
+    if (backend->protocol != PROTOCOL_PLAIN) {
+      /* Let the cmd stop working on the query this one supersedes. */
+      if (backend->generation) {
+        ret = writer_printf(&backend->writer, "cancel %u\n", backend->generation);
+      }
+      backend->generation++;
+      ret = ret || writer_printf(&backend->writer, "query %u %s\n", backend->generation, current_query);
+    } else {
+      ret = writer_printf(&backend->writer, "%s\n", current_query);
+    }
+    ret = ret || backend_flush(backend);
+  }
+  if (ret) {
+    fprintf(stderr, "Failed to write to %s.\n", backend->settings->cmd);
+  } else {
+    trace_instant("query written", backend->settings->cmd);
+#ifdef TRACE
+    backend->awaiting_first_byte = 1;
+#endif
+    if (backend->protocol == PROTOCOL_PLAIN && !backend->plugin.handle && !script) {
+      backend->in_flight++;
+    }
+    if (backend->to_fd != -1 && backend->settings->watchdog && !backend->unanswered) {
+      /* Counted from the oldest query it owes an answer to. */
+      backend->unanswered = 1;
+      loop_timer_arm(backend->watchdog_timer, backend->settings->watchdog);
+    }
+  }
+  free(backend->sent_query);
+  backend->sent_query = strdup(current_query);
+
+  debounce_sent(&backend->debounce, debounce_now());
+  if (backend->settings->timeout) {
+    loop_timer_arm(backend->timeout_timer, backend->settings->timeout);
+  }
+}
+
+/* @brief Sends the held back query of a backend once it is due. */
+static void handle_debounce_timer(uint32_t expirations, void *args) {
+  backend_t *backend = args;
+  if (debounce_due(&backend->debounce, debounce_now())) {
+    backend_send(backend);
+  } else {
+    loop_timer_arm(backend->debounce_timer, debounce_timeout(&backend->debounce, debounce_now()));
+  }
+}
+
+/* @brief Called when the pipe of a backend that was full takes bytes again. */
+static void handle_writable(uint32_t events, void *args) {
+  backend_t *backend = args;
+  if (backend_flush(backend)) {
+    fprintf(stderr, "Failed to write to %s.\n", backend->settings->cmd);
+    return;
+  }
+  if (!writer_pending(&backend->writer) && backend->send_pending) {
+    backend_send(backend);
+  }
+}
+
+/* @brief Called when a backend didn't answer the current query in time.
+ *
+ * Its results answer an older query, so they're taken off the screen rather
+ * than shown next to the up to date results of the other backends.
+ */
+static void handle_timeout(uint32_t expirations, void *args) {
+  backend_t *backend = args;
+  debug("%s didn't answer in %ums.\n", backend->settings->cmd, backend->settings->timeout);
+  if (backend_runs_script(backend)) {
+    script_stop(backend);
+  } else if (backend->plugin.handle) {
+    plugin_cancel(&backend->plugin, backend->generation);
+  } else if (backend->to_fd != -1 && backend->protocol != PROTOCOL_PLAIN) {
+    if (!writer_printf(&backend->writer, "cancel %u\n", backend->generation)) {
+      backend_flush(backend);
+    }
+  }
+  if (backend->set.count) {
+    clear_results(backend);
+    merge_results();
+  }
+}
+
+/* @brief Called when a backend owed an answer and didn't send anything for
+ *        as long as its watchdog allows.  It's killed, which restarts it.
+ */
+static void handle_watchdog(uint32_t expirations, void *args) {
+  backend_t *backend = args;
+  backend->unanswered = 0;
+  if (backend->pid > 0 && backend->to_fd != -1) {
+    fprintf(stderr, "%s stopped responding for %ums, restarting it.\n",
+        backend->settings->cmd, backend->settings->watchdog);
+    kill(backend->pid, SIGKILL);
+  }
+}
+
+/* @brief Expands a cmd line into an argument vector.
+ *
+ * @param cmd The command line from the configuration file.
+ * @param args Extra arguments to append, or NULL.
+ * @param expanded Holds the expanded words, free it with wordfree().
+ * @return The argument vector (free it), or NULL on failure.
+ */
+static char **build_argv(char *cmd, char **args, wordexp_t *expanded) {
+  if (wordexp(cmd, expanded, 0) || !expanded->we_wordc) {
+    fprintf(stderr, "Error expanding file %s\n", cmd);
+    return NULL;
+  }
+
+  size_t i, nargs = 0;
+  while (args && args[nargs]) {
+    nargs++;
+  }
+
+  char **argv = malloc((expanded->we_wordc + nargs + 1) * sizeof(char *));
+  if (!argv) {
+    wordfree(expanded);
+    return NULL;
+  }
+  for (i = 0; i < expanded->we_wordc; i++) {
+    argv[i] = expanded->we_wordv[i];
+  }
+  for (i = 0; i < nargs; i++) {
+    argv[expanded->we_wordc + i] = args[i];
+  }
+  argv[expanded->we_wordc + nargs] = NULL;
+  return argv;
+}
+
+/* @brief Runs the script of a backend on the current query, in a process
+ *        group of its own, and listens to it.
+ *
+ * @param backend The backend, its script mustn't be running.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t script_start(backend_t *backend) {
+  char *args[] = { current_query, NULL };
+  wordexp_t expanded;
+  char **argv = build_argv(backend->settings->cmd, args, &expanded);
+  if (!argv) {
+    return -1;
+  }
+  int32_t ret = spawn_script(argv, &backend->isolation, &backend->pid, &backend->from_fd);
+  free(argv);
+  wordfree(&expanded);
+  if (ret) {
+    return -1;
+  }
+  jobs[job_count].pid = backend->pid;
+  jobs[job_count++].kill_at = 0;
+
+  fcntl(backend->from_fd, F_SETFL, fcntl(backend->from_fd, F_GETFL) | O_NONBLOCK);
+  if (reader_init(&backend->reader, settings.max_result_size)
+      || loop_add(backend->from_fd, EPOLLIN, get_results, backend)) {
+    script_stop(backend);
+    return -1;
+  }
+  return 0;
+}
+
+/* @brief Arms the kill timer for the first terminated script due. */
+static void arm_kill_timer(void) {
+  uint64_t first = 0;
+  uint32_t i;
+  for (i = 0; i < job_count; i++) {
+    if (jobs[i].kill_at && (!first || jobs[i].kill_at < first)) {
+      first = jobs[i].kill_at;
+    }
+  }
+  if (!first) {
+    loop_timer_arm(kill_timer, -1);
+    return;
+  }
+  uint64_t now = debounce_now();
+  loop_timer_arm(kill_timer, first > now ? first - now : 0);
+}
+
+/* @brief Kills the process groups of the scripts that were terminated
+ *        EXIT_GRACE ms ago and are still around, so they give up their slot.
+ */
+static void handle_kill_timer(uint32_t expirations, void *args) {
+  uint64_t now = debounce_now();
+  uint32_t i;
+  for (i = 0; i < job_count; i++) {
+    if (jobs[i].kill_at && jobs[i].kill_at <= now) {
+      debug("Killing script %d, it didn't exit in %ums.\n", jobs[i].pid, EXIT_GRACE);
+      kill(-jobs[i].pid, SIGKILL);
+      jobs[i].kill_at = 0;
+    }
+  }
+  arm_kill_timer();
+}
+
+/* @brief Terminates the process group of the script a backend runs, if any,
+ *        and stops listening to it.  It keeps its slot until it's reaped,
+ *        and gets SIGKILL if that takes longer than EXIT_GRACE ms.
+ *
+ * @param backend The backend.
+ * @return Void.
+ */
+static void script_stop(backend_t *backend) {
+  if (backend->pid > 0) {
+    kill(-backend->pid, SIGTERM);
+    uint32_t i;
+    for (i = 0; i < job_count && jobs[i].pid != backend->pid; i++);
+    if (i < job_count) {
+      jobs[i].kill_at = debounce_now() + EXIT_GRACE;
+      arm_kill_timer();
+    }
+    backend->pid = 0;
+  }
+  if (backend->from_fd != -1) {
+    loop_remove(backend->from_fd);
+    close(backend->from_fd);
+    backend->from_fd = -1;
+    reader_free(&backend->reader);
+  }
+}
+
+/* @brief Frees the slot of a script that was reaped and starts the scripts
+ *        that waited for one.
+ *
+ * @param pid The process that was reaped.
+ * @return 0 if it was a script and -1 if it wasn't.
+ */
+static int32_t script_reaped(pid_t pid) {
+  uint32_t i;
+  for (i = 0; i < job_count && jobs[i].pid != pid; i++);
+  if (i == job_count) {
+    return -1;
+  }
+  jobs[i] = jobs[--job_count];
+  arm_kill_timer();
+
+  for (i = 0; i < backend_count; i++) {
+    backend_t *backend = &backends[i];
+    if (backend->settings->script && backend->pid == pid) {
+      /* It's done, what it left running in the background would hold its
+       * standard out open.  What it printed is still read up to the end. */
+      kill(-pid, SIGTERM);
+      backend->pid = 0;
+    }
+  }
+  for (i = 0; i < backend_count && job_count < settings.max_jobs; i++) {
+    if (backend_runs_script(&backends[i]) && backends[i].send_pending) {
+      backend_send(&backends[i]);
+    }
+  }
+  return 0;
+}
+
+/* @brief Spawns the zygote of a script backend, it speaks the tagged
+ *        protocol.  The script is run once per query if it can't be.
+ *
+ * @param backend The backend.
+ * @return Void.
+ */
+static void zygote_spawn(backend_t *backend) {
+  wordexp_t script_expanded, expanded;
+  char **script_argv = build_argv(backend->settings->cmd, NULL, &script_expanded);
+  if (!script_argv) {
+    return;
+  }
+  char **argv = build_argv(backend->settings->zygote, script_argv, &expanded);
+  if (argv) {
+    if (backend->settings->protocol != PROTOCOL_PLAIN && backend->settings->protocol != PROTOCOL_TAGGED) {
+      fprintf(stderr, "The zygote of %s speaks the tagged protocol, ignoring the protocol set for it.\n", backend->settings->cmd);
+    }
+    backend->protocol = PROTOCOL_TAGGED;
+    if (spawn_piped_process(argv, 0, &backend->isolation, &backend->pid, &backend->to_fd, &backend->from_fd)) {
+      fprintf(stderr, "Couldn't start the zygote of %s, running it directly.\n", backend->settings->cmd);
+      backend->pid = 0;
+      backend->to_fd = backend->from_fd = -1;
+    }
+    free(argv);
+    wordfree(&expanded);
+  }
+  free(script_argv);
+  wordfree(&script_expanded);
+}
+
+/* @brief Spawns the cmd of a backend that is kept running.
+ *
+ * @param backend The backend.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t process_spawn(backend_t *backend) {
+  wordexp_t expanded;
+  char **argv = build_argv(backend->settings->cmd, backend->settings->pass_args ? spawn_args : NULL, &expanded);
+  if (!argv) {
+    return -1;
+  }
+  int32_t ret = spawn_piped_process(argv, backend->protocol == PROTOCOL_MEMFD,
+      &backend->isolation, &backend->pid, &backend->to_fd, &backend->from_fd);
+  free(argv);
+  wordfree(&expanded);
+  return ret;
+}
+
+/* @brief Hooks the pipes of a process that was just spawned up to the
+ *        event loop.
+ *
+ * @param backend The backend.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t process_connect(backend_t *backend) {
+  /* Neither side of the pipes may ever hold up the loop. */
+  fcntl(backend->to_fd, F_SETFL, fcntl(backend->to_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(backend->from_fd, F_SETFL, fcntl(backend->from_fd, F_GETFL) | O_NONBLOCK);
+  if (backend->protocol == PROTOCOL_DELTA && delta_init(&backend->delta)) {
+    return -1;
+  }
+  if (writer_init(&backend->writer) || reader_init(&backend->reader, settings.max_result_size)
+      || loop_add(backend->from_fd, EPOLLIN, get_results, backend)) {
+    return -1;
+  }
+  return 0;
+}
+
+/* @brief Arms the restart of a cmd that exited, unless it kept exiting
+ *        without ever responding.
+ *
+ * @param backend The backend.
+ * @return Void.
+ */
+static void schedule_restart(backend_t *backend) {
+  if (backend->restarts >= MAX_RESTARTS) {
+    fprintf(stderr, "%s keeps exiting, giving up on it.\n", backend->settings->cmd);
+    return;
+  }
+  uint32_t delay = RESTART_DELAY << backend->restarts;
+  if (delay > RESTART_DELAY_MAX) {
+    delay = RESTART_DELAY_MAX;
+  }
+  backend->restarts++;
+  fprintf(stderr, "Restarting %s in %ums.\n", backend->settings->cmd, delay);
+  loop_timer_arm(backend->restart_timer, delay);
+}
+
+/* @brief Respawns the cmd of a backend once it's backed off, and sends it
+ *        the current query again.
+ */
+static void handle_restart(uint32_t expirations, void *args) {
+  backend_t *backend = args;
+  if (backend->from_fd != -1) {
+    /* Whatever the old process left in the pipe answers nothing anymore. */
+    loop_remove(backend->from_fd);
+    close(backend->from_fd);
+    backend->from_fd = -1;
+    reader_free(&backend->reader);
+  }
+  /* The new process starts out with none of the results the old one sent. */
+  delta_free(&backend->delta);
+
+  if (process_spawn(backend)) {
+    backend->pid = 0;
+    backend->to_fd = backend->from_fd = -1;
+    schedule_restart(backend);
+    return;
+  }
+  if (process_connect(backend)) {
+    /* Its exit brings it back here. */
+    kill(backend->pid, SIGKILL);
+    return;
+  }
+  backend->in_flight = 0;
+  backend->send_pending = 0;
+  backend->more = 0;
+  backend->page_requested = 0;
+  backend_send(backend);
+}
+
+/* @brief Spawns the cmd of a backend (or loads it, for a plugin) and hooks
+ *        it up to the event loop.
+ *
+ * @param backend The backend, its settings must be set.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t backend_spawn(backend_t *backend) {
+  if (!backend->settings->plugin) {
+    /* Plugins run in lighthouse itself, there is nothing to isolate. */
+    isolate_init(&backend->isolation, backend->settings, backend - backends);
+  }
+  if (backend->settings->script) {
+    if (backend->settings->zygote) {
+      zygote_spawn(backend);
+    }
+  } else if (backend->settings->plugin) {
+    wordexp_t expanded;
+    char **argv = build_argv(backend->settings->cmd, backend->settings->pass_args ? spawn_args : NULL, &expanded);
+    if (!argv) {
+      return -1;
+    }
+    int32_t ret = plugin_load(&backend->plugin, argv, &backend->parse_slot);
+    free(argv);
+    wordfree(&expanded);
+    if (ret) {
+      return -1;
+    }
+  } else if (process_spawn(backend)) {
+    return -1;
+  }
+
+  debounce_init(&backend->debounce, settings.debounce_max);
+  if (cache_init(&backend->cache, settings.cache_size / settings.backend_count)) {
+    return -1;
+  }
+  backend->debounce_timer = loop_timer_new(handle_debounce_timer, backend);
+  backend->timeout_timer = loop_timer_new(handle_timeout, backend);
+  backend->watchdog_timer = loop_timer_new(handle_watchdog, backend);
+  backend->restart_timer = loop_timer_new(handle_restart, backend);
+  if (backend->debounce_timer == -1 || backend->timeout_timer == -1
+      || backend->watchdog_timer == -1 || backend->restart_timer == -1) {
+    return -1;
+  }
+  if (backend->settings->plugin || backend_runs_script(backend)) {
+    /* Answers come through the parse slot, or scripts are run per query. */
+    return 0;
+  }
+  return process_connect(backend);
+}
+
+/* @brief Asks the backend a result came from for its description.  Only
+ *        line based protocols can answer it.
+ */
+static int32_t request_description(uint32_t index, uint32_t id, const char *action) {
+  if (index >= source_count) {
+    return -1;
+  }
+  backend_t *backend = &backends[sources[index].backend];
+  if (backend->to_fd == -1 || (backend->protocol != PROTOCOL_TAGGED
+        && backend->protocol != PROTOCOL_DELTA)) {
+    return -1;
+  }
+  if (writer_printf(&backend->writer, "describe %u %s\n", id, action) || backend_flush(backend)) {
+    fprintf(stderr, "Failed to write to %s.\n", backend->settings->cmd);
+    return -1;
+  }
+  return 0;
+}
+
+/* @brief Appends a page of results to those a backend holds, then merges
+ *        and draws them.
+ *
+ * Only the first page of an answer is cached, copying the whole set for
+ * every page would cost more and more as the pages add up.
+ *
+ * @param backend The backend that answered.
+ * @param page The parsed page, the backend takes ownership of it.
+ * @return Void.
+ */
+static void backend_append_results(backend_t *backend, result_set_t *page) {
+  backend->page_requested = 0;
+  if (result_set_append(&backend->set, page)) {
+    fprintf(stderr, "Couldn't append a page of results from %s.\n", backend->settings->cmd);
+    result_set_free(page);
+    return;
+  }
+  debug("Paged in %d results from %s.\n", backend->set.count, backend->settings->cmd);
+  merge_results();
+}
+
+/* @brief Asks every backend whose results end close below the highlight
+ *        for its next page.
+ */
+static void request_pages(void) {
+  /* A page is asked for once the end of the results is on screen. */
+  uint32_t margin = settings.max_height / settings.height;
+  uint32_t i;
+  for (i = 0; i < backend_count; i++) {
+    backend_t *backend = &backends[i];
+    /* Cmds with top_k set send their whole answer at once. */
+    if (!backend->more || backend->page_requested || backend->to_fd == -1
+        || backend->settings->top_k || global.result_highlight + margin < merged_end[i]) {
+      continue;
+    }
+    if (writer_printf(&backend->writer, "page %u %u\n", backend->generation, backend->set.count)
+        || backend_flush(backend)) {
+      fprintf(stderr, "Failed to write to %s.\n", backend->settings->cmd);
+      continue;
+    }
+    backend->page_requested = 1;
+  }
+}
+
+/* @brief Takes the answers the parser thread is done with. */
+static void handle_parsed(uint32_t events, void *args) {
+  uint32_t i;
+  for (i = 0; i < backend_count; i++) {
+    backend_t *backend = &backends[i];
+    parse_job_t *job = parser_take(&backend->parse_slot);
+    if (!job) {
+      continue;
+    }
+    /* A newer query may have been sent while it was being parsed. */
+    if ((backend->protocol != PROTOCOL_PLAIN || backend->plugin.handle || backend->settings->script)
+        && job->generation != backend->generation) {
+      debug("Dropping results for generation %u.\n", job->generation);
+      parser_job_free(job);
+      continue;
+    }
+    if (job->page && !backend->page_requested) {
+      /* The query changed since the page was asked for. */
+      parser_job_free(job);
+      continue;
+    }
+    /* The job lives in the arena of its set, it goes with it. */
+    result_set_t set = job->set;
+    backend->more = job->more;
+    if (job->page) {
+      backend_append_results(backend, &set);
+    } else {
+      backend_set_results(backend, &set);
+    }
+  }
+}
+
+int32_t backends_start(struct result_params *params, char **args) {
+  draw_params = params;
+  spawn_args = args;
+  kill_timer = loop_timer_new(handle_kill_timer, NULL);
+  if (kill_timer == -1) {
+    return -1;
+  }
+
+  uint32_t i;
+  for (i = 0; i < settings.backend_count; i++) {
+    backend_t *backend = &backends[backend_count];
+    memset(backend, 0, sizeof(backend_t));
+    backend->settings = &settings.backends[i];
+    backend->protocol = backend->settings->protocol;
+    backend->from_fd = -1;
+    backend->to_fd = -1;
+    backend->isolation.procs_fd = -1;
+    if (backend_spawn(backend)) {
+      fprintf(stderr, "Failed to spawn %s.\n", backend->settings->cmd);
+      isolate_free(&backend->isolation);
+      continue;
+    }
+    backend_count++;
+  }
+  if (!backend_count) {
+    return -1;
+  }
+
+  describe_init(request_description);
+  for (i = 0; i < backend_count; i++) {
+    parser_add_slot(&backends[i].parse_slot);
+  }
+  return parser_start(handle_parsed, NULL);
+}
+
+/* @brief Reaps the cmds and scripts that were terminated, blocking on
+ *        SIGCHLD rather than polling, and kills the ones still running after
+ *        EXIT_GRACE ms.
+ *
+ * @return Void.
+ */
+static void reap_all(void) {
+  /* Scripts are killed with their whole process group. */
+  pid_t pids[MAX_BACKENDS + MAX_JOBS];
+  uint32_t i, count = 0;
+  for (i = 0; i < backend_count; i++) {
+    if (backends[i].pid > 0) {
+      pids[count++] = backends[i].pid;
+      backends[i].pid = 0;
+    }
+  }
+  while (job_count) {
+    pids[count++] = -jobs[--job_count].pid;
+  }
+
+  sigset_t child, old;
+  sigemptyset(&child);
+  sigaddset(&child, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &child, &old);
+
+  struct timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += EXIT_GRACE / 1000;
+  deadline.tv_nsec += (EXIT_GRACE % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  while (count) {
+    for (i = 0; i < count;) {
+      pid_t ret = waitpid(pids[i] < 0 ? -pids[i] : pids[i], NULL, WNOHANG);
+      if (ret == 0 || (ret < 0 && errno == EINTR)) {
+        i++;
+      } else {
+        pids[i] = pids[--count];
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec left = {
+      deadline.tv_sec - now.tv_sec,
+      deadline.tv_nsec - now.tv_nsec
+    };
+    if (left.tv_nsec < 0) {
+      left.tv_sec--;
+      left.tv_nsec += 1000000000L;
+    }
+    if (!count || left.tv_sec < 0) {
+      break;
+    }
+    /* SIGCHLD stays pending if a child exited since it was waited for. */
+    sigtimedwait(&child, NULL, &left);
+  }
+  for (i = 0; i < count; i++) {
+    fprintf(stderr, "Killing process %d, it didn't exit in %ums.\n", pids[i] < 0 ? -pids[i] : pids[i], EXIT_GRACE);
+    kill(pids[i], SIGKILL);
+    waitpid(pids[i] < 0 ? -pids[i] : pids[i], NULL, 0);
+  }
+  sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void backends_stop(void) {
+  uint32_t i;
+  /* Plugins may still be answering from their threads. */
+  for (i = 0; i < backend_count; i++) {
+    plugin_unload(&backends[i].plugin);
+  }
+  parser_stop();
+
+  for (i = 0; i < backend_count; i++) {
+    if (backend_runs_script(&backends[i])) {
+      script_stop(&backends[i]);
+    } else if (backends[i].pid > 0) {
+      kill(backends[i].pid, SIGTERM);
+    }
+  }
+  reap_all();
+  for (i = 0; i < backend_count; i++) {
+    debug("%s: %llu cache hits, %llu misses.\n", backends[i].settings->cmd,
+        (unsigned long long)backends[i].cache.hits, (unsigned long long)backends[i].cache.misses);
+    cache_free(&backends[i].cache);
+    delta_free(&backends[i].delta);
+    isolate_free(&backends[i].isolation);
+    writer_free(&backends[i].writer);
+    free(backends[i].sent_query);
+    backends[i].sent_query = NULL;
+  }
+  free(previous_query);
+  previous_query = NULL;
+  describe_free();
+}
+
+void backends_query(char *query) {
+  current_query = query;
+
+  /* Show what we already know about the query while the cmds work on it:
+   * an earlier answer to the same query, or else the current results minus
+   * the ones that can't match anymore when the query was typed on. */
+  int32_t extended = settings.narrow && previous_query
+      && strlen(query) > strlen(previous_query)
+      && !strncmp(query, previous_query, strlen(previous_query));
+  uint32_t i, changed = 0;
+  for (i = 0; i < backend_count; i++) {
+    result_set_t set;
+    /* Pages of the results of the last query are of no use anymore. */
+    backends[i].more = 0;
+    backends[i].page_requested = 0;
+    if (backends[i].protocol == PROTOCOL_DELTA) {
+      /* The cmd sends changes to what it sent, it has to stay shown. */
+      continue;
+    }
+    if (!cache_lookup(&backends[i].cache, query, &set)) {
+      replace_results(&backends[i], &set);
+      changed++;
+    } else if (extended) {
+      changed += narrow_results(&backends[i], query);
+    }
+  }
+  if (changed) {
+    merge_results();
+  }
+  free(previous_query);
+  previous_query = strdup(query);
+
+  uint64_t now = debounce_now();
+  for (i = 0; i < backend_count; i++) {
+    backend_t *backend = &backends[i];
+    if (debounce_key(&backend->debounce, now)) {
+      backend_send(backend);
+    } else {
+      /* Wake up when the held back query is due. */
+      loop_timer_arm(backend->debounce_timer, debounce_timeout(&backend->debounce, now));
+    }
+  }
+}
+
+void backends_scrolled(void) {
+  request_pages();
+}
+
+void backends_reset(void) {
+  uint32_t i;
+  for (i = 0; i < backend_count; i++) {
+    clear_results(&backends[i]);
+  }
+  free(global.results);
+  global.results = NULL;
+  global.result_count = 0;
+  free(sources);
+  sources = NULL;
+  source_count = 0;
+}
+
+void backend_answered(backend_t *backend) {
+  loop_timer_arm(backend->timeout_timer, -1);
+  debounce_response(&backend->debounce, debounce_now());
+}
+
+void backend_set_results(backend_t *backend, result_set_t *set) {
+  backend_answered(backend);
+
+  replace_results(backend, set);
+  debug("Recieved %d results from %s.\n", backend->set.count, backend->settings->cmd);
+
+  /* Only cache an answer we know the query of: a tagged one is checked
+   * against the generation, a plain one has to be the last outstanding.
+   * Delta answers are never looked up. */
+  if ((backend->protocol != PROTOCOL_PLAIN || !backend->in_flight)
+      && backend->protocol != PROTOCOL_DELTA) {
+    cache_store(&backend->cache, backend->sent_query, &backend->set);
+  }
+
+  merge_results();
+}
+
+int32_t backend_take_description(char *line, size_t length) {
+  int32_t shown;
+  if (describe_answer(line, length, &shown)) {
+    return -1;
+  }
+  if (shown) {
+    draw_result_text(draw_params->connection, draw_params->window, draw_params->cr, draw_params->cr_surface, global.results);
+  }
+  return 0;
+}
+
+int32_t backend_highlight(backend_t *backend, uint32_t *index) {
+  if (global.result_highlight >= source_count
+      || sources[global.result_highlight].backend != (uint32_t)(backend - backends)) {
+    return -1;
+  }
+  *index = sources[global.result_highlight].index;
+  return 0;
+}
+
+void backend_set_highlight(backend_t *backend, uint32_t index) {
+  pending_highlight.backend = backend;
+  pending_highlight.index = index;
+}
+
+void backend_exited(pid_t pid, int status) {
+  if (!script_reaped(pid)) {
+    return;
+  }
+  uint32_t i;
+  for (i = 0; i < backend_count; i++) {
+    backend_t *backend = &backends[i];
+    if (backend->pid != pid) {
+      continue;
+    }
+    fprintf(stderr, "%s exited with status %d.\n", backend->settings->cmd, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    backend->pid = 0;
+    backend->unanswered = 0;
+    loop_timer_arm(backend->timeout_timer, -1);
+    loop_timer_arm(backend->debounce_timer, -1);
+    loop_timer_arm(backend->watchdog_timer, -1);
+    if (backend->to_fd != -1) {
+      if (backend->write_blocked) {
+        loop_remove(backend->to_fd);
+        backend->write_blocked = 0;
+      }
+      close(backend->to_fd);
+      backend->to_fd = -1;
+      writer_free(&backend->writer);
+    }
+    if (backend->settings->script) {
+      /* The zygote died, its script is run directly from now on. */
+      backend->protocol = backend->settings->protocol;
+      if (backend->from_fd != -1) {
+        loop_remove(backend->from_fd);
+        close(backend->from_fd);
+        backend->from_fd = -1;
+        reader_free(&backend->reader);
+      }
+      backend_send(backend);
+    } else {
+      schedule_restart(backend);
+    }
+    return;
+  }
+}
+
+void backend_responded(backend_t *backend) {
+  if (backend->unanswered) {
+    loop_timer_arm(backend->watchdog_timer, -1);
+    backend->unanswered = 0;
+  }
+  backend->restarts = 0;
+}
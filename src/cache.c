@@ -0,0 +1,155 @@
+/** @file cache.c
+ *
+ *  @brief This file contains the cache that lets results already received
+ *         for a query be shown again without waiting for the cmd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "globals.h"
+
+/* @brief Buckets of the hash table, entries are chained. */
+#define CACHE_BUCKETS     256
+
+/* @brief FNV-1a. */
+static uint32_t hash_query(const char *query) {
+  uint32_t hash = 2166136261u;
+  while (*query) {
+    hash ^= (uint8_t)*query++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* @brief Finds the entry of a query, NULL if there is none. */
+static cache_entry_t *find_entry(cache_t *cache, const char *query, uint32_t hash) {
+  cache_entry_t *entry;
+  for (entry = cache->buckets[hash % cache->bucket_count]; entry; entry = entry->chain) {
+    if (entry->hash == hash && !strcmp(entry->query, query)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void unlink_entry(cache_t *cache, cache_entry_t *entry) {
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    cache->newest = entry->older;
+  }
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    cache->oldest = entry->newer;
+  }
+  entry->newer = entry->older = NULL;
+}
+
+static void push_newest(cache_t *cache, cache_entry_t *entry) {
+  entry->older = cache->newest;
+  entry->newer = NULL;
+  if (cache->newest) {
+    cache->newest->newer = entry;
+  }
+  cache->newest = entry;
+  if (!cache->oldest) {
+    cache->oldest = entry;
+  }
+}
+
+/* @brief Takes an entry out of the cache and frees it. */
+static void remove_entry(cache_t *cache, cache_entry_t *entry) {
+  cache_entry_t **link = &cache->buckets[entry->hash % cache->bucket_count];
+  while (*link != entry) {
+    link = &(*link)->chain;
+  }
+  *link = entry->chain;
+  unlink_entry(cache, entry);
+
+  cache->size -= entry->size;
+  free(entry->query);
+  result_set_free(&entry->set);
+  free(entry);
+}
+
+int32_t cache_init(cache_t *cache, size_t max_size) {
+  memset(cache, 0, sizeof(cache_t));
+  cache->max_size = max_size;
+  if (!max_size) {
+    return 0;
+  }
+  cache->bucket_count = CACHE_BUCKETS;
+  cache->buckets = calloc(cache->bucket_count, sizeof(cache_entry_t *));
+  if (!cache->buckets) {
+    return -1;
+  }
+  return 0;
+}
+
+void cache_free(cache_t *cache) {
+  while (cache->oldest) {
+    remove_entry(cache, cache->oldest);
+  }
+  free(cache->buckets);
+  cache->buckets = NULL;
+}
+
+void cache_store(cache_t *cache, const char *query, const result_set_t *set) {
+  if (!cache->buckets || !query) {
+    return;
+  }
+
+  size_t query_length = strlen(query);
+  size_t size = sizeof(cache_entry_t) + query_length + 1 + set->length + 1 + set->count * sizeof(result_t);
+  uint32_t hash = hash_query(query);
+  cache_entry_t *old = find_entry(cache, query, hash);
+  if (old) {
+    remove_entry(cache, old);
+  }
+  if (size > cache->max_size) {
+    return;
+  }
+
+  cache_entry_t *entry = calloc(1, sizeof(cache_entry_t));
+  if (!entry) {
+    return;
+  }
+  entry->query = malloc(query_length + 1);
+  if (!entry->query || result_set_copy(set, &entry->set)) {
+    free(entry->query);
+    free(entry);
+    return;
+  }
+  memcpy(entry->query, query, query_length + 1);
+  entry->hash = hash;
+  entry->size = size;
+
+  while (cache->oldest && cache->size + size > cache->max_size) {
+    remove_entry(cache, cache->oldest);
+  }
+  entry->chain = cache->buckets[hash % cache->bucket_count];
+  cache->buckets[hash % cache->bucket_count] = entry;
+  push_newest(cache, entry);
+  cache->size += size;
+}
+
+int32_t cache_lookup(cache_t *cache, const char *query, result_set_t *set) {
+  if (!cache->buckets || !query) {
+    return -1;
+  }
+
+  cache_entry_t *entry = find_entry(cache, query, hash_query(query));
+  if (!entry || result_set_copy(&entry->set, set)) {
+    cache->misses++;
+    return -1;
+  }
+  cache->hits++;
+
+  unlink_entry(cache, entry);
+  push_newest(cache, entry);
+  return 0;
+}
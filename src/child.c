@@ -1,122 +1,358 @@
 /** @file child.c
  *  @author Bram Wasti <bwasti@cmu.edu>
  *  
- *  @brief This file contains the logic that is run in a separate thread
+ *  @brief This file contains the logic that is run by the event loop
  *         to pull results from the spawned user defined process.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
-#include <stdarg.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
-#include <wordexp.h>
 
+#include "backend.h"
 #include "child.h"
 #include "display.h"
 #include "globals.h"
+#include "loop.h"
+#include "memfd.h"
+#include "reader.h"
 #include "results.h"
+#include "trace.h"
 
-/* @brief Checks if the buffer has a newline.
+/* @brief Strips the header off a line sent with the tagged protocol.
  *
- * If there is a newline it is replaced with a null terminator
- * and 1 is returned, otherwise 0 is returned.
+ * @param header The message the line has to be, with a trailing space.
+ * @param[in/out] line A reference to the line, moved past the header.
+ * @param[in/out] length A reference to the length of the line.
+ * @param more A reference to be populated with whether the cmd has more
+ *        results to page in.
+ * @return The generation the results answer, or 0 if the line isn't that
+ *         message.
+ */
+static uint32_t strip_tagged_header(const char *header, char **line, size_t *length, int32_t *more) {
+  size_t header_length = strlen(header);
+  if (strncmp(*line, header, header_length)) {
+    return 0;
+  }
+  char *end;
+  uint32_t generation = strtoul(*line + header_length, &end, 10);
+  if (*end == ' ') {
+    end++;
+  }
+  *more = !strncmp(end, "more", 4) && (end[4] == ' ' || !end[4]);
+  if (*more) {
+    end += end[4] ? 5 : 4;
+  }
+  *length -= end - *line;
+  *line = end;
+  return generation;
+}
+
+/* @brief Hands a page of results sent with the tagged protocol over to the
+ *        parser thread, to be appended to those of the backend.
  *
- * @param buf The buffer to be scanned for a newline.
- * @param len The length of the buffer.
- * @return 1 if there exists a newline in the buffer, else 0.
+ * @param backend The backend the page came from.
+ * @param line The line holding the page.
+ * @param length The length of the line.
+ * @return 0 if the line is a page and -1 if it isn't.
  */
-int32_t find_newline(char *buf, size_t len) {
-  uint32_t i;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == '\n') {
-      buf[i] = '\0';
-      return 1;
-    }
-    if (buf[i] == '\0') {
-      return 0;
-    }
+static int32_t get_page(backend_t *backend, char *line, size_t length) {
+  int32_t more;
+  uint32_t generation = strip_tagged_header("page ", &line, &length, &more);
+  if (!generation) {
+    return -1;
+  }
+  if (generation != backend->generation || !backend->page_requested) {
+    debug("Dropping page for generation %u.\n", generation);
+    return 0;
+  }
+  parse_job_t *job = parser_job_new(line, length, generation);
+  if (!job) {
+    fprintf(stderr, "Couldn't allocate %zu bytes for results.\n", length + 1);
+    return 0;
   }
+  job->page = 1;
+  job->more = more;
+  parser_submit(&backend->parse_slot, job);
   return 0;
 }
 
+/* @brief Takes the newest frame sent with the binary protocol and hands it
+ *        over, in place, as the results of the backend.
+ *
+ * @param backend The backend the frames came from.
+ * @return Void.
+ */
+static void get_frame_results(backend_t *backend) {
+  char *record, *frame = NULL;
+  size_t length, frame_length = 0;
+  while ((record = reader_next_frame(&backend->reader, &length))) {
+    frame = record;
+    frame_length = length;
+  }
+  if (!frame) {
+    return;
+  }
+
+  /* Drop answers to superseded queries before spending time on them. */
+  uint32_t generation = 0;
+  if (frame_length >= sizeof(generation)) {
+    memcpy(&generation, frame, sizeof(generation));
+  }
+  if (generation != backend->generation) {
+    debug("Dropping results for generation %u.\n", generation);
+    return;
+  }
 
-void *get_results(void *args) {
-  int32_t fd = ((struct result_params *)args)->fd;
-  cairo_t *cairo_context = ((struct result_params *)args)->cr;
-  cairo_surface_t *cairo_surface = ((struct result_params *)args)->cr_surface;
-  xcb_connection_t *connection = ((struct result_params *)args)->connection;
-  xcb_window_t window = ((struct result_params *)args)->window;
+  /* The results point straight into the receive buffer, so the results
+   * take it over and the reader starts a new one. */
+  result_set_t set;
+  memset(&set, 0, sizeof(set));
+  set.arena = arena_new(frame_length / 2);
+  if (!set.arena) {
+    fprintf(stderr, "Couldn't allocate %zu bytes for results.\n", frame_length / 2);
+    return;
+  }
+  char *buf = reader_take(&backend->reader);
+  if (!buf || arena_adopt(set.arena, buf)) {
+    fprintf(stderr, "Couldn't allocate a new result buffer.\n");
+    free(buf);
+    result_set_free(&set);
+    return;
+  }
+  trace_begin("parse_result_frame");
+  int32_t ret = parse_result_frame(frame, frame_length, &generation, &set.results, &set.count, set.arena);
+  trace_end("parse_result_frame");
+  if (ret) {
+    result_set_free(&set);
+    return;
+  }
+  /* The frame ends with the null byte of its last field. */
+  set.text = buf;
+  set.length = frame + frame_length - 1 - buf;
+  backend_set_results(backend, &set);
+}
 
-  int64_t res;
+/* @brief Maps the newest result set passed over the socket of the memfd
+ *        protocol and hands it over, in place, as the results of the
+ *        backend.
+ *
+ * @param backend The backend the memfd came from.
+ * @param fd The memfd.
+ * @return Void.
+ */
+static void get_memfd_results(backend_t *backend, int32_t fd) {
+  result_set_t set;
+  uint32_t generation;
+  if (memfd_map(fd, settings.max_result_size, &set, &generation)) {
+    return;
+  }
+  if (generation != backend->generation) {
+    debug("Dropping results for generation %u.\n", generation);
+    result_set_free(&set);
+    return;
+  }
+  backend_set_results(backend, &set);
+}
 
-  while (1) {
-    /* Read until a new line. */
-    res = 0;
-    int32_t ret;
-    do {
-      ret = read(fd, global.result_buf + res, sizeof(global.result_buf) - res);
-      res += ret;
-    } while(!find_newline(global.result_buf, sizeof(global.result_buf))
-            && ret > 0);
+/* @brief Applies every operation sent with the delta protocol and shows the
+ *        results they leave.
+ *
+ * @param backend The backend the operations came from.
+ * @return Void.
+ */
+static void get_delta_results(backend_t *backend) {
+  /* Keep the highlight on its result, wherever the operations move it. */
+  char *anchor = NULL;
+  uint32_t index;
+  if (!backend_highlight(backend, &index) && index < backend->delta.count) {
+    anchor = strdup(delta_id(&backend->delta, index));
+  }
 
-    if (res < 0) {
-      fprintf(stderr, "Error in spawned cmd.\n");
-      return NULL;
-    } else if (res == 0) {
-      return NULL;
+  char *line;
+  size_t length;
+  int32_t changed = 0;
+  uint32_t generation;
+  uint32_t done = backend->delta.done;
+  while ((line = reader_next(&backend->reader, &length))) {
+    if (!backend_take_description(line, length)) {
+      continue;
     }
-    result_t *results = NULL;
-    uint32_t result_count = parse_result_text(global.result_buf, res, &results);
-    pthread_mutex_lock(&global.result_mutex);
-    if (global.results && results != global.results) {
-      free(global.results);
+    int32_t ret = delta_apply(&backend->delta, line, length, &generation);
+    if (ret < 0) {
+      fprintf(stderr, "Invalid operation from %s.\n", backend->settings->cmd);
+      continue;
     }
-    global.results = results;
-    global.result_count = result_count;
-    debug("Recieved %d results.\n", result_count);
-    if (global.result_count) {
-        draw_result_text(connection, window, cairo_context, cairo_surface, results);
-    } else {
-      /* If no result found, just draw an empty window. */
-      uint32_t values[] = { settings.width, settings.height };
-      xcb_configure_window (connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
-      cairo_xcb_surface_set_size(cairo_surface, settings.width, settings.height);
+    changed |= ret;
+  }
+
+  result_set_t set;
+  if (changed && !delta_snapshot(&backend->delta, &set)) {
+    int32_t found = anchor ? delta_find(&backend->delta, anchor) : -1;
+    if (found >= 0) {
+      backend_set_highlight(backend, found);
     }
-    pthread_mutex_unlock(&global.result_mutex);
+    backend_set_results(backend, &set);
+  } else if (backend->delta.done != done && backend->delta.done == backend->generation) {
+    /* The results already answered the query. */
+    backend_answered(backend);
   }
+  free(anchor);
 }
 
-/* @brief Writes to the passed in file descriptor.
+/* @brief Hands everything a script printed over to the parser thread, once
+ *        it closed its standard out.
  *
- * Note: this function is used exclusively to write to the child process.
+ * @param backend The backend running the script.
+ * @return Void.
+ */
+static void get_script_results(backend_t *backend) {
+  size_t length = 0;
+  char *output = reader_rest(&backend->reader, &length);
+  if (!output) {
+    /* It found nothing, its results are none. */
+    output = "";
+  }
+  /* Scripts may print their results over several lines. */
+  char *c;
+  for (c = output; (c = memchr(c, '\n', output + length - c)); c++) {
+    *c = ' ';
+  }
+  parse_job_t *job = parser_job_new(output, length, backend->generation);
+  if (!job) {
+    fprintf(stderr, "Couldn't allocate %zu bytes for results.\n", length + 1);
+    return;
+  }
+  job->top_k = backend->settings->top_k;
+  parser_submit(&backend->parse_slot, job);
+}
+
+/* @brief Reads what a backend sent and hands its newest answer on.
  *
- * @param child The file descriptor to write to.
- * @return 0 on success and 1 on failure.
+ * @param backend The backend that has something to read.
+ * @return Void.
  */
-int32_t write_to_remote(FILE *child, char *format, ...) {
-  va_list args;
-  va_start(args, format);
-  if (vfprintf(child, format, args) < 0) {
-    return -1;
+static void read_results(backend_t *backend) {
+  int32_t fd = backend->from_fd;
+
+  int32_t memfd = -1;
+  ssize_t res;
+  if (backend->protocol == PROTOCOL_MEMFD) {
+    res = memfd_receive(fd, &memfd);
+  } else {
+    res = reader_fill(&backend->reader, fd);
   }
-  va_end(args);
-  if (fflush(child)) {
-    return -1;
+  if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (res <= 0) {
+    if (res < 0) {
+      fprintf(stderr, "Error in spawned cmd.\n");
+    } else if (backend_runs_script(backend)) {
+      get_script_results(backend);
+    }
+    /* The cmd is gone, stop listening to it. */
+    loop_remove(fd);
+    close(fd);
+    reader_free(&backend->reader);
+    backend->from_fd = -1;
+    return;
   }
+  backend_responded(backend);
 
-  return 0;
+#ifdef TRACE
+  if (backend->awaiting_first_byte) {
+    trace_instant("first byte", backend->settings->cmd);
+    backend->awaiting_first_byte = 0;
+  }
+#endif
+
+  if (backend_runs_script(backend)) {
+    /* A script is done once it closes its standard out. */
+    return;
+  }
+  if (backend->protocol == PROTOCOL_MEMFD) {
+    if (memfd != -1) {
+      get_memfd_results(backend, memfd);
+    }
+    return;
+  }
+  if (backend->protocol == PROTOCOL_BINARY) {
+    get_frame_results(backend);
+    return;
+  }
+  if (backend->protocol == PROTOCOL_DELTA) {
+    get_delta_results(backend);
+    return;
+  }
+
+  /* Only the newest complete line matters, older ones are already stale. */
+  char *record, *line = NULL;
+  size_t length, line_length = 0;
+  uint32_t records = 0;
+  while ((record = reader_next(&backend->reader, &length))) {
+    if (backend->protocol == PROTOCOL_TAGGED
+        && (!backend_take_description(record, length) || !get_page(backend, record, length))) {
+      continue;
+    }
+    line = record;
+    line_length = length;
+    records++;
+  }
+  if (!line) {
+    return;
+  }
+  /* Every line answers one plain query. */
+  backend->in_flight -= records < backend->in_flight ? records : backend->in_flight;
+
+  uint32_t generation = 0;
+  int32_t more = 0;
+  if (backend->protocol == PROTOCOL_TAGGED) {
+    /* Drop answers to superseded queries before spending time on them. */
+    generation = strip_tagged_header("results ", &line, &line_length, &more);
+    if (generation != backend->generation) {
+      debug("Dropping results for generation %u.\n", generation);
+      return;
+    }
+  }
+
+  /* Give the answer its own copy of the text so the reader is free to
+   * reuse its buffer, and leave the parsing to the parser thread so keys
+   * keep being handled meanwhile. */
+  parse_job_t *job = parser_job_new(line, line_length, generation);
+  if (!job) {
+    fprintf(stderr, "Couldn't allocate %zu bytes for results.\n", line_length + 1);
+    return;
+  }
+  job->more = more;
+  job->top_k = backend->settings->top_k;
+  parser_submit(&backend->parse_slot, job);
+}
+
+void get_results(uint32_t events, void *args) {
+  trace_begin("get_results");
+  read_results(args);
+  trace_end("get_results");
 }
 
 /* @brief Spawns a process (via fork) and sets up pipes to allow communication with
  *        the user defined executable.
  *
- * @param file The user defined file to load into the newly spawned process.
+ * @param argv The arguments of the process, argv[0] is the file to execute.
+ * @param use_socket If set, the standard out of the process is a Unix socket
+ *        instead of a pipe, so it can pass descriptors.
+ * @param isolation Applied to the process, NULL for none.
+ * @param pid A reference to be populated with the pid of the process.
  * @param to_child_fd The fd used to write to the child process.
  * @param from_child_fd The fd used to read from the child process.
  * @return 0 on success and 1 on failure.
  */
-int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_child_fd, char **argv) {
+int32_t spawn_piped_process(char **argv, int32_t use_socket, const isolation_t *isolation, pid_t *pid, int32_t *to_child_fd, int32_t *from_child_fd) {
   /* Create pipes for IPC with the user process. */
   int32_t in_pipe[2];
   int32_t out_pipe[2];
@@ -127,7 +363,7 @@ int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_chil
     return -1;
   }
 
-  if (pipe(out_pipe)) {
+  if (use_socket ? socketpair(AF_UNIX, SOCK_STREAM, 0, out_pipe) : pipe(out_pipe)) {
     fprintf(stderr, "Couldn't create pipe 2: %s\n", strerror(errno));
     return -1;
   }
@@ -139,33 +375,72 @@ int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_chil
   }
 
   if (child_pid == 0) {
+    /* Signals the loop handles are blocked, don't pass that on. */
+    loop_unblock_signals();
+    isolate_apply(isolation);
     close(in_pipe[1]);
     dup2(in_pipe[0], STDIN_FILENO);
     dup2(out_pipe[1], STDOUT_FILENO);
 
-    wordexp_t expanded_file;
-    if (wordexp(file, &expanded_file, 0)) {
-      fprintf(stderr, "Error expanding file %s\n", file);
-    } else {
-      file = expanded_file.we_wordv[0];
-    }
-
-    argv[0] = file;
-    execvp(file, (char * const *)argv);
-    fprintf(stderr, "Couldn't execute file: %s\n", strerror(errno));
-    close(out_pipe[1]);
-    close(in_pipe[0]);
-    return -1;
+    execvp(argv[0], (char * const *)argv);
+    fprintf(stderr, "Couldn't execute file %s: %s\n", argv[0], strerror(errno));
+    _exit(1);
   }
 
-  global.child_pid = child_pid;
+  *pid = child_pid;
 
   /* We don't need to read from in_pipe or write to out_pipe. */
   close(in_pipe[0]);
   close(out_pipe[1]);
 
+  /* Other processes spawned later shouldn't hold on to these. */
+  fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(in_pipe[1], F_SETFD, FD_CLOEXEC);
+
   *from_child_fd = out_pipe[0];
   *to_child_fd = in_pipe[1];
   return 0;
 }
 
+int32_t spawn_script(char **argv, const isolation_t *isolation, pid_t *pid, int32_t *from_child_fd) {
+  int32_t out_pipe[2];
+  pid_t child_pid;
+
+  if (pipe(out_pipe)) {
+    fprintf(stderr, "Couldn't create pipe: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if ((child_pid = fork()) == -1) {
+    fprintf(stderr, "Couldn't spawn script: %s\n", strerror(errno));
+    close(out_pipe[0]);
+    close(out_pipe[1]);
+    return -1;
+  }
+
+  if (child_pid == 0) {
+    /* Its own group, so whatever it starts goes down with it. */
+    setpgid(0, 0);
+    loop_unblock_signals();
+    isolate_apply(isolation);
+    close(out_pipe[0]);
+    int32_t null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd != -1) {
+      dup2(null_fd, STDIN_FILENO);
+      close(null_fd);
+    }
+    dup2(out_pipe[1], STDOUT_FILENO);
+
+    execvp(argv[0], (char * const *)argv);
+    fprintf(stderr, "Couldn't execute file %s: %s\n", argv[0], strerror(errno));
+    _exit(1);
+  }
+
+  /* Set on both sides, the group may be signaled before the child runs. */
+  setpgid(child_pid, child_pid);
+  *pid = child_pid;
+  close(out_pipe[1]);
+  fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+  *from_child_fd = out_pipe[0];
+  return 0;
+}
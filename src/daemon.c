@@ -0,0 +1,241 @@
+/** @file daemon.c
+ *
+ *  @brief This file contains the socket a resident lighthouse listens on
+ *         and the thin client that talks to it.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+/* @brief What a client sends to ask for the popup. */
+#define SHOW_REQUEST      "show\n"
+
+static struct {
+  int32_t listen_fd;
+  int32_t client_fd; /* The client waiting for an action, -1 if hidden. */
+  struct sockaddr_un addr;
+  loop_callback_t show;
+  loop_callback_t hide;
+  void *data;
+} daemon_state = { -1, -1 };
+
+/* @brief Fills in the address of the daemon socket:
+ *        $XDG_RUNTIME_DIR/lighthouse.sock or /tmp/lighthouse-<uid>/lighthouse.sock.
+ *
+ * Anyone can create things in /tmp, so the directory there is only used if
+ * it's ours and nobody else can get in it.
+ *
+ * @param addr The address to fill in.
+ * @param create Whether to create the directory in /tmp if it's missing.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t socket_address(struct sockaddr_un *addr, int32_t create) {
+  memset(addr, 0, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir) {
+    if (snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/lighthouse.sock", runtime_dir) >= (int)sizeof(addr->sun_path)) {
+      fprintf(stderr, "The path of the daemon socket in %s is too long.\n", runtime_dir);
+      return -1;
+    }
+    return 0;
+  }
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "/tmp/lighthouse-%u", (uint32_t)getuid());
+  if (create && mkdir(dir, 0700) && errno != EEXIST) {
+    fprintf(stderr, "Couldn't create %s: %s\n", dir, strerror(errno));
+    return -1;
+  }
+  struct stat info;
+  if (lstat(dir, &info)) {
+    fprintf(stderr, "Couldn't look at %s: %s\n", dir, strerror(errno));
+    return -1;
+  }
+  if (!S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077)) {
+    fprintf(stderr, "Not using %s, it's not a directory only we can get in.\n", dir);
+    return -1;
+  }
+  snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/lighthouse.sock", dir);
+  return 0;
+}
+
+/* @brief Whether the other end of a connected socket runs as our user. */
+static int32_t same_user(int32_t fd) {
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length)) {
+    return 0;
+  }
+  return credentials.uid == getuid();
+}
+
+/* @brief Called when the waiting client sends something or goes away. */
+static void handle_client(uint32_t events, void *data) {
+  char buf[64];
+  ssize_t ret = read(daemon_state.client_fd, buf, sizeof(buf));
+  if (ret > 0 || (ret < 0 && errno == EAGAIN)) {
+    /* Just the request, nothing to do. */
+    return;
+  }
+  /* The client gave up (^C), nobody is waiting for the popup anymore. */
+  daemon_reply(NULL);
+  daemon_state.hide(0, daemon_state.data);
+}
+
+/* @brief Accepts a client and shows (or hides) the popup. */
+static void handle_connection(uint32_t events, void *data) {
+  int32_t fd = accept4(daemon_state.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd == -1) {
+    return;
+  }
+  if (!same_user(fd)) {
+    close(fd);
+    return;
+  }
+
+  if (daemon_state.client_fd != -1) {
+    /* Asking again while the popup is shown toggles it off. */
+    close(fd);
+    daemon_reply(NULL);
+    daemon_state.hide(0, daemon_state.data);
+    return;
+  }
+
+  daemon_state.client_fd = fd;
+  if (loop_add(fd, EPOLLIN, handle_client, NULL)) {
+    close(fd);
+    daemon_state.client_fd = -1;
+    return;
+  }
+  daemon_state.show(0, daemon_state.data);
+}
+
+int32_t daemon_listen(loop_callback_t show, loop_callback_t hide, void *data) {
+  daemon_state.show = show;
+  daemon_state.hide = hide;
+  daemon_state.data = data;
+  if (socket_address(&daemon_state.addr, 1)) {
+    return -1;
+  }
+
+  /* A socket nobody answers on is left over from a daemon that died. */
+  int32_t probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe != -1 && !connect(probe, (struct sockaddr *)&daemon_state.addr, sizeof(daemon_state.addr))) {
+    fprintf(stderr, "A lighthouse daemon is already running on %s.\n", daemon_state.addr.sun_path);
+    close(probe);
+    return -1;
+  }
+  if (probe != -1) {
+    close(probe);
+  }
+  unlink(daemon_state.addr.sun_path);
+
+  daemon_state.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (daemon_state.listen_fd == -1) {
+    fprintf(stderr, "Couldn't create the daemon socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  /* Only we may connect, whatever directory the socket is in. */
+  mode_t mask = umask(077);
+  int32_t ret = bind(daemon_state.listen_fd, (struct sockaddr *)&daemon_state.addr, sizeof(daemon_state.addr));
+  umask(mask);
+  if (ret
+      || listen(daemon_state.listen_fd, 4)
+      || loop_add(daemon_state.listen_fd, EPOLLIN, handle_connection, NULL)) {
+    fprintf(stderr, "Couldn't listen on %s: %s\n", daemon_state.addr.sun_path, strerror(errno));
+    close(daemon_state.listen_fd);
+    daemon_state.listen_fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void daemon_close(void) {
+  daemon_reply(NULL);
+  if (daemon_state.listen_fd != -1) {
+    loop_remove(daemon_state.listen_fd);
+    close(daemon_state.listen_fd);
+    unlink(daemon_state.addr.sun_path);
+    daemon_state.listen_fd = -1;
+  }
+}
+
+void daemon_reply(const char *action) {
+  int32_t fd = daemon_state.client_fd;
+  if (fd == -1) {
+    return;
+  }
+  daemon_state.client_fd = -1;
+  loop_remove(fd);
+
+  if (action) {
+    /* Actions are small, simply wait for the client to take it. */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    size_t length = strlen(action);
+    while (length) {
+      ssize_t ret = write(fd, action, length);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      } else if (ret <= 0) {
+        break;
+      }
+      action += ret;
+      length -= ret;
+    }
+  }
+  close(fd);
+}
+
+int32_t daemon_client(void) {
+  struct sockaddr_un addr;
+  if (socket_address(&addr, 0)) {
+    return 1;
+  }
+
+  int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    fprintf(stderr, "Couldn't reach the lighthouse daemon on %s: %s\n", addr.sun_path, strerror(errno));
+    if (fd != -1) {
+      close(fd);
+    }
+    return 1;
+  }
+  /* What it answers ends up in a shell, it has to be one of ours. */
+  if (!same_user(fd)) {
+    fprintf(stderr, "The lighthouse daemon on %s runs as another user, not asking it.\n", addr.sun_path);
+    close(fd);
+    return 1;
+  }
+
+  if (write(fd, SHOW_REQUEST, strlen(SHOW_REQUEST)) < 0) {
+    close(fd);
+    return 1;
+  }
+
+  char buf[4096];
+  ssize_t ret;
+  while ((ret = read(fd, buf, sizeof(buf))) != 0) {
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    fwrite(buf, 1, ret, stdout);
+  }
+  close(fd);
+  return 0;
+}
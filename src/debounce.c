@@ -0,0 +1,78 @@
+/** @file debounce.c
+ *
+ *  @brief This file contains the logic deciding when a query is written to
+ *         the spawned user defined process.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+
+#include "debounce.h"
+
+#define min(a,b) ((a) < (b) ? (a) : (b))
+
+uint64_t debounce_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void debounce_init(debounce_t *d, uint32_t max_latency) {
+  memset(d, 0, sizeof(debounce_t));
+  d->max_latency = max_latency;
+}
+
+/* @brief Returns when the held query has to be sent.
+ *
+ * We wait for a pause in typing as long as the cmd usually takes to answer,
+ * but never past max_latency after the query was first held.
+ */
+static inline uint64_t debounce_deadline(debounce_t *d) {
+  uint64_t delay = min(d->response_time, d->max_latency);
+  return min(d->last_key + delay, d->pending_since + d->max_latency);
+}
+
+int32_t debounce_key(debounce_t *d, uint64_t now) {
+  d->last_key = now;
+
+  /* Fast cmds and idle cmds get the query immediately. */
+  if (!d->max_latency || !d->response_time || (!d->awaiting && !d->pending)) {
+    d->pending = 0;
+    return 1;
+  }
+
+  if (!d->pending) {
+    d->pending = 1;
+    d->pending_since = now;
+  }
+  return debounce_due(d, now);
+}
+
+int32_t debounce_due(debounce_t *d, uint64_t now) {
+  return d->pending && now >= debounce_deadline(d);
+}
+
+int32_t debounce_timeout(debounce_t *d, uint64_t now) {
+  if (!d->pending) {
+    return -1;
+  }
+  uint64_t deadline = debounce_deadline(d);
+  return deadline > now ? (int32_t)(deadline - now) : 0;
+}
+
+void debounce_sent(debounce_t *d, uint64_t now) {
+  d->pending = 0;
+  d->awaiting = 1;
+  d->last_sent = now;
+}
+
+void debounce_response(debounce_t *d, uint64_t now) {
+  if (!d->awaiting) {
+    return;
+  }
+  uint64_t sample = now - d->last_sent;
+  d->response_time = d->response_time ? (3 * d->response_time + sample) / 4 : sample;
+  d->awaiting = 0;
+}
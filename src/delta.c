@@ -0,0 +1,320 @@
+/** @file delta.c
+ *
+ *  @brief This file contains the results of cmds that send changes to their
+ *         results instead of all of them on every answer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+
+/* @brief Buckets of the id table, entries are chained. */
+#define DELTA_BUCKETS     1024
+
+/* @brief FNV-1a. */
+static uint32_t hash_id(const char *id) {
+  uint32_t hash = 2166136261u;
+  while (*id) {
+    hash ^= (uint8_t)*id++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* @brief Takes the next space separated word off a line.
+ *
+ * @param[in/out] c A reference to the current position, moved past the word.
+ * @return The word (null terminated), or NULL if the line ended.
+ */
+static char *next_word(char **c) {
+  while (**c == ' ') {
+    (*c)++;
+  }
+  if (!**c) {
+    return NULL;
+  }
+  char *word = *c;
+  while (**c && **c != ' ') {
+    (*c)++;
+  }
+  if (**c) {
+    *(*c)++ = '\0';
+  }
+  return word;
+}
+
+static delta_entry_t *find_entry(const delta_t *delta, const char *id, uint32_t hash) {
+  delta_entry_t *entry;
+  for (entry = delta->buckets[hash % delta->bucket_count]; entry; entry = entry->chain) {
+    if (entry->hash == hash && !strcmp(entry->data, id)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/* @brief Creates an entry holding copies of an id and the fields of a result. */
+static delta_entry_t *new_entry(const char *id, const result_t *result) {
+  size_t id_length = strlen(id) + 1;
+  size_t text_length = strlen(result->text) + 1;
+  size_t action_length = result->action ? strlen(result->action) + 1 : 0;
+  size_t desc_length = result->desc ? strlen(result->desc) + 1 : 0;
+
+  delta_entry_t *entry = calloc(1, sizeof(delta_entry_t));
+  if (!entry) {
+    return NULL;
+  }
+  entry->size = text_length + action_length + desc_length;
+  entry->data = malloc(id_length + entry->size);
+  if (!entry->data) {
+    free(entry);
+    return NULL;
+  }
+  char *c = entry->data;
+  memcpy(c, id, id_length);
+  c += id_length;
+  entry->result.text = memcpy(c, result->text, text_length);
+  c += text_length;
+  if (result->action) {
+    entry->result.action = memcpy(c, result->action, action_length);
+    c += action_length;
+  }
+  if (result->desc) {
+    entry->result.desc = memcpy(c, result->desc, desc_length);
+  }
+  entry->result.score = result->score;
+  entry->hash = hash_id(id);
+  return entry;
+}
+
+/* @brief Takes an entry out of the id table and the order, and frees it. */
+static void remove_entry(delta_t *delta, delta_entry_t *entry) {
+  delta_entry_t **link = &delta->buckets[entry->hash % delta->bucket_count];
+  while (*link != entry) {
+    link = &(*link)->chain;
+  }
+  *link = entry->chain;
+
+  uint32_t i;
+  for (i = 0; delta->order[i] != entry; i++);
+  memmove(&delta->order[i], &delta->order[i + 1], (delta->count - i - 1) * sizeof(delta_entry_t *));
+  delta->count--;
+
+  delta->size -= entry->size;
+  free(entry->data);
+  free(entry);
+}
+
+/* @brief Puts an entry into the id table and the order.
+ *
+ * @param delta The set.
+ * @param entry The entry, its id mustn't be taken.
+ * @param index Where it goes, past the end appends it.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t insert_entry(delta_t *delta, delta_entry_t *entry, uint32_t index) {
+  if (delta->count == delta->max) {
+    uint32_t max = delta->max ? delta->max * 2 : 64;
+    delta_entry_t **order = realloc(delta->order, max * sizeof(delta_entry_t *));
+    if (!order) {
+      return -1;
+    }
+    delta->order = order;
+    delta->max = max;
+  }
+  if (index > delta->count) {
+    index = delta->count;
+  }
+  memmove(&delta->order[index + 1], &delta->order[index], (delta->count - index) * sizeof(delta_entry_t *));
+  delta->order[index] = entry;
+  delta->count++;
+
+  entry->chain = delta->buckets[entry->hash % delta->bucket_count];
+  delta->buckets[entry->hash % delta->bucket_count] = entry;
+  delta->size += entry->size;
+  return 0;
+}
+
+/* @brief Parses the single {text|action|desc} at the end of an operation
+ *        and makes an entry out of it.
+ */
+static delta_entry_t *parse_entry(const char *id, char *fields) {
+  arena_t *arena = arena_new(2 * sizeof(result_t));
+  if (!arena) {
+    return NULL;
+  }
+  result_t *results;
+  delta_entry_t *entry = NULL;
+  if (parse_result_text(fields, strlen(fields), 0, &results, arena) == 1) {
+    entry = new_entry(id, &results[0]);
+  }
+  arena_free(arena);
+  return entry;
+}
+
+/* @brief Moves the listed results to the front, in the order listed, the
+ *        others keep their order behind them.
+ */
+static int32_t reorder(delta_t *delta, char *c) {
+  delta_entry_t **order = malloc((delta->max ? delta->max : 1) * sizeof(delta_entry_t *));
+  if (!order) {
+    return -1;
+  }
+  uint32_t i, count = 0;
+  char *id;
+  while ((id = next_word(&c))) {
+    delta_entry_t *entry = find_entry(delta, id, hash_id(id));
+    if (entry && !entry->placed) {
+      entry->placed = 1;
+      order[count++] = entry;
+    }
+  }
+  for (i = 0; i < delta->count; i++) {
+    if (!delta->order[i]->placed) {
+      order[count++] = delta->order[i];
+    }
+    delta->order[i]->placed = 0;
+  }
+  free(delta->order);
+  delta->order = order;
+  return 0;
+}
+
+int32_t delta_init(delta_t *delta) {
+  memset(delta, 0, sizeof(delta_t));
+  delta->bucket_count = DELTA_BUCKETS;
+  delta->buckets = calloc(delta->bucket_count, sizeof(delta_entry_t *));
+  if (!delta->buckets) {
+    return -1;
+  }
+  return 0;
+}
+
+void delta_free(delta_t *delta) {
+  uint32_t i;
+  for (i = 0; i < delta->count; i++) {
+    free(delta->order[i]->data);
+    free(delta->order[i]);
+  }
+  free(delta->order);
+  free(delta->buckets);
+  memset(delta, 0, sizeof(delta_t));
+}
+
+int32_t delta_apply(delta_t *delta, char *line, size_t length, uint32_t *generation) {
+  char *c = line;
+  char *op = next_word(&c);
+  char *tag = next_word(&c);
+  if (!op || !tag || sscanf(tag, "%u", generation) != 1) {
+    return -1;
+  }
+
+  if (!strcmp(op, "done")) {
+    delta->done = *generation;
+    return 0;
+  }
+  if (!strcmp(op, "reset")) {
+    if (!delta->count) {
+      return 0;
+    }
+    uint32_t done = delta->done;
+    delta_free(delta);
+    if (delta_init(delta)) {
+      return -1;
+    }
+    delta->done = done;
+    return 1;
+  }
+  if (!strcmp(op, "order")) {
+    return reorder(delta, c) ? -1 : 1;
+  }
+
+  char *id = next_word(&c);
+  if (!id) {
+    return -1;
+  }
+  delta_entry_t *old = find_entry(delta, id, hash_id(id));
+  if (!strcmp(op, "remove")) {
+    if (!old) {
+      return 0;
+    }
+    remove_entry(delta, old);
+    return 1;
+  }
+
+  uint32_t index;
+  if (!strcmp(op, "insert")) {
+    char *position = next_word(&c);
+    if (!position || sscanf(position, "%u", &index) != 1) {
+      return -1;
+    }
+  } else if (!strcmp(op, "update")) {
+    if (!old) {
+      fprintf(stderr, "Update of unknown result %s.\n", id);
+      return -1;
+    }
+    for (index = 0; delta->order[index] != old; index++);
+  } else {
+    return -1;
+  }
+
+  delta_entry_t *entry = parse_entry(id, c);
+  if (!entry) {
+    return -1;
+  }
+  if (old) {
+    /* Inserting a known id moves it. */
+    remove_entry(delta, old);
+  }
+  if (insert_entry(delta, entry, index)) {
+    free(entry->data);
+    free(entry);
+    return -1;
+  }
+  return 1;
+}
+
+int32_t delta_snapshot(const delta_t *delta, result_set_t *set) {
+  memset(set, 0, sizeof(result_set_t));
+  set->arena = arena_new(delta->size + 1 + (delta->count + 1) * sizeof(result_t));
+  if (!set->arena) {
+    return -1;
+  }
+  set->text = arena_alloc(set->arena, delta->size + 1);
+  set->results = arena_alloc(set->arena, (delta->count + 1) * sizeof(result_t));
+  if (!set->text || !set->results) {
+    result_set_free(set);
+    return -1;
+  }
+
+  /* The fields of an entry are contiguous, past its id. */
+  char *c = set->text;
+  uint32_t i;
+  for (i = 0; i < delta->count; i++) {
+    const delta_entry_t *entry = delta->order[i];
+    const result_t *result = &entry->result;
+    memcpy(c, result->text, entry->size);
+    set->results[i].text = c;
+    set->results[i].action = result->action ? c + (result->action - result->text) : NULL;
+    set->results[i].desc = result->desc ? c + (result->desc - result->text) : NULL;
+    set->results[i].score = result->score;
+    c += entry->size;
+  }
+  memset(&set->results[delta->count], 0, sizeof(result_t));
+  *c = '\0';
+  set->count = delta->count;
+  set->length = delta->size;
+  return 0;
+}
+
+int32_t delta_find(const delta_t *delta, const char *id) {
+  delta_entry_t *entry = find_entry(delta, id, hash_id(id));
+  if (!entry) {
+    return -1;
+  }
+  uint32_t i;
+  for (i = 0; delta->order[i] != entry; i++);
+  return i;
+}
@@ -0,0 +1,130 @@
+/** @file describe.c
+ *
+ *  @brief This file contains the descriptions cmds send only for the results
+ *         the highlight lands on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "describe.h"
+#include "globals.h"
+
+/* @brief Number of descriptions kept, the oldest is replaced beyond it. */
+#define DESCRIBE_CACHE    64
+
+/* @brief A description asked for, by action. */
+typedef struct {
+  char *action;
+  char *desc;       /* NULL until answered, or if there is none. */
+  uint32_t id;      /* Of the request. */
+  int32_t pending;  /* Set until answered. */
+} description_t;
+
+static description_t descriptions[DESCRIBE_CACHE];
+static uint32_t next_slot;
+static uint32_t last_id;
+static describe_request_t request_description;
+
+/* @brief Copies length bytes of a string into a new null terminated one. */
+static char *copy_string(const char *string, size_t length) {
+  char *copy = malloc(length + 1);
+  if (copy) {
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+static void clear_description(description_t *description) {
+  free(description->action);
+  free(description->desc);
+  memset(description, 0, sizeof(description_t));
+}
+
+void describe_init(describe_request_t request) {
+  request_description = request;
+}
+
+void describe_free(void) {
+  uint32_t i;
+  for (i = 0; i < DESCRIBE_CACHE; i++) {
+    clear_description(&descriptions[i]);
+  }
+  next_slot = 0;
+  request_description = NULL;
+}
+
+const char *describe_result(uint32_t index, const result_t *result) {
+  if (!describe_is_lazy(result->desc)) {
+    return result->desc;
+  }
+  if (!result->action || !request_description) {
+    return NULL;
+  }
+
+  uint32_t i;
+  for (i = 0; i < DESCRIBE_CACHE; i++) {
+    description_t *description = &descriptions[i];
+    if (description->action && !strcmp(description->action, result->action)) {
+      return description->pending ? "" : description->desc;
+    }
+  }
+
+  description_t *description = &descriptions[next_slot];
+  next_slot = (next_slot + 1) % DESCRIBE_CACHE;
+  clear_description(description);
+  description->action = copy_string(result->action, strlen(result->action));
+  if (!description->action) {
+    return NULL;
+  }
+  description->id = ++last_id;
+  /* Remembered even if the cmd can't be asked, so it isn't asked again. */
+  if (request_description(index, description->id, result->action)) {
+    return NULL;
+  }
+  debug("Asked for the description of %s.\n", result->action);
+  description->pending = 1;
+  return "";
+}
+
+/* @brief Returns whether a description is the one the highlighted result
+ *        waits for.
+ */
+static int32_t is_highlighted(const description_t *description) {
+  if (global.result_highlight >= global.result_count) {
+    return 0;
+  }
+  const result_t *result = &global.results[global.result_highlight];
+  return result->action && describe_is_lazy(result->desc)
+      && !strcmp(result->action, description->action);
+}
+
+int32_t describe_answer(const char *line, size_t length, int32_t *shown) {
+  static const char header[] = "desc ";
+  *shown = 0;
+  if (length < sizeof(header) - 1 || strncmp(line, header, sizeof(header) - 1)) {
+    return -1;
+  }
+  char *end;
+  uint32_t id = strtoul(line + sizeof(header) - 1, &end, 10);
+  if (*end == ' ') {
+    end++;
+  }
+  size_t desc_length = length - (end - line);
+
+  uint32_t i;
+  for (i = 0; i < DESCRIBE_CACHE; i++) {
+    description_t *description = &descriptions[i];
+    if (description->pending && description->id == id) {
+      description->pending = 0;
+      description->desc = desc_length ? copy_string(end, desc_length) : NULL;
+      *shown = is_highlighted(description);
+      return 0;
+    }
+  }
+  /* Answers to descriptions already replaced are dropped. */
+  debug("Dropping description %u.\n", id);
+  return 0;
+}
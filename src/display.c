@@ -6,11 +6,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wordexp.h>
 
+#include "describe.h"
 #include "display.h"
 #include "globals.h"
+#include "trace.h"
 
 #define min(a,b) ((a) < (b) ? (a) : (b))
 
@@ -21,6 +24,66 @@ typedef struct {
   uint32_t image_y;
 } offset_t;
 
+/* @brief What a line of results showed when it was last drawn. */
+typedef struct {
+  uint64_t hash;        /* Of the text, see hash_text(). */
+  int32_t drawn;        /* Unset if the line has to be drawn. */
+  int32_t title;
+  int32_t highlighted;
+} drawn_line_t;
+
+/* @brief The lines of results on screen, so those that didn't change aren't
+ *        laid out and painted again.
+ */
+static struct {
+  drawn_line_t *lines;
+  uint32_t count;
+  uint32_t width;       /* The size of the window they were drawn in. */
+  uint32_t height;
+} drawn;
+
+/* @brief Checks whether a line of results already shows a result.
+ *
+ * @param line The index of the line, counting from the first result.
+ * @param result The result.
+ * @param highlighted Set if the result is highlighted.
+ * @return 1 if the line is up to date, else 0.
+ */
+static int32_t line_is_drawn(uint32_t line, const result_t *result, int32_t highlighted) {
+  if (line >= drawn.count || !drawn.lines[line].drawn) {
+    return 0;
+  }
+  drawn_line_t *drawn_line = &drawn.lines[line];
+  return drawn_line->highlighted == highlighted && drawn_line->title == !result->action
+      && drawn_line->hash == hash_text(result->text);
+}
+
+/* @brief Notes what a line of results was drawn with. */
+static void set_line_drawn(uint32_t line, const result_t *result, int32_t highlighted) {
+  if (line >= drawn.count) {
+    drawn_line_t *lines = realloc(drawn.lines, (line + 1) * sizeof(drawn_line_t));
+    if (!lines) {
+      return;
+    }
+    memset(&lines[drawn.count], 0, (line + 1 - drawn.count) * sizeof(drawn_line_t));
+    drawn.lines = lines;
+    drawn.count = line + 1;
+  }
+  drawn_line_t *drawn_line = &drawn.lines[line];
+  drawn_line->hash = hash_text(result->text);
+  drawn_line->drawn = 1;
+  drawn_line->title = !result->action;
+  drawn_line->highlighted = highlighted;
+}
+
+void draw_invalidate(void) {
+  uint32_t i;
+  for (i = 0; i < drawn.count; i++) {
+    drawn.lines[i].drawn = 0;
+  }
+  drawn.width = drawn.height = 0;
+}
+
 /* @brief Returns the offset for a line of text.
  *
  * @param line the index of the line to be drawn (counting from the top).
@@ -51,8 +114,6 @@ static inline offset_t calculate_line_offset(uint32_t line) {
  * @return Void.
  */
 static void draw_typed_line(cairo_t *cr, char *text, uint32_t line, uint32_t cursor, color_t *foreground, color_t *background) {
-  pthread_mutex_lock(&global.draw_mutex);
-
   /* Set the background. */
   cairo_set_source_rgb(cr, background->r, background->g, background->b);
   cairo_rectangle(cr, 0, line * settings.height, settings.width, (line + 1) * settings.height);
@@ -101,8 +162,6 @@ static void draw_typed_line(cairo_t *cr, char *text, uint32_t line, uint32_t cur
     cairo_stroke_preserve(cr);
     cairo_fill(cr);
   }
-
-  pthread_mutex_unlock(&global.draw_mutex);
 }
 
 #ifndef NO_PANGO
@@ -407,13 +466,11 @@ static image_format_t draw_image(cairo_t *cr, draw_t *charac, offset_t offset, u
  * @return Void.
  */
 static void draw_line(cairo_t *cr, const char *text, uint32_t line, color_t *foreground, color_t *background) {
-  pthread_mutex_lock(&global.draw_mutex);
-
   cairo_set_source_rgb(cr, background->r, background->g, background->b);
   /* Add 2 offset to height to prevent flickery drawing over the typed text.
    * TODO: Use better math all around. */
-  cairo_rectangle(cr, 0, line * settings.height + 2, settings.width, (line + 1) * settings.height);
-  cairo_stroke_preserve(cr);
+  /* Only fill the line itself, the others may not be drawn again. */
+  cairo_rectangle(cr, 0, line * settings.height + 2, settings.width, settings.height);
   cairo_fill(cr);
   offset_t offset = calculate_line_offset(line);
 
@@ -468,7 +525,6 @@ static void draw_line(cairo_t *cr, const char *text, uint32_t line, color_t *for
   pango_font_description_free (font_description);
 #endif
   free(modifiers_array);
-  pthread_mutex_unlock(&global.draw_mutex);
 }
 
 /* @brief Draw a description to a cairo context.
@@ -480,7 +536,6 @@ static void draw_line(cairo_t *cr, const char *text, uint32_t line, color_t *for
  * @return Void.
  */
 static void draw_desc(cairo_t *cr, const char *text, color_t *foreground, color_t *background) {
-  pthread_mutex_lock(&global.draw_mutex);
   cairo_set_source_rgb(cr, background->r, background->g, background->b);
   uint32_t desc_height = settings.height*(global.result_count+1);
   cairo_rectangle(cr, settings.width + 2, 0,
@@ -563,7 +618,6 @@ static void draw_desc(cairo_t *cr, const char *text, color_t *foreground, color_
   pango_font_description_free (font_description);
 #endif
   free(modifiers_array);
-  pthread_mutex_unlock(&global.draw_mutex);
 }
 
 void draw_query_text(cairo_t *cr, cairo_surface_t *surface, const char *text, uint32_t cursor) {
@@ -571,8 +625,20 @@ void draw_query_text(cairo_t *cr, cairo_surface_t *surface, const char *text, ui
   cairo_surface_flush(surface);
 }
 
+/* @brief Forgets what was drawn if the window gets a new size, X doesn't
+ *        keep the contents of a resized window.
+ */
+static void check_window_size(uint32_t width, uint32_t height) {
+  if (width != drawn.width || height != drawn.height) {
+    draw_invalidate();
+    drawn.width = width;
+    drawn.height = height;
+  }
+}
+
 void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, result_t *results) {
   int32_t line, index;
+  trace_begin("draw_result_text");
   if (global.result_count - 1 < global.result_highlight) {
     global.result_highlight = global.result_count - 1;
   }
@@ -597,8 +663,11 @@ void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t
       global.result_offset = global.result_highlight;
   }
 
-  if ((global.result_highlight < global.result_count) &&
-          results[global.result_highlight].desc) {
+  const char *desc = NULL;
+  if (global.result_highlight < global.result_count) {
+    desc = describe_result(global.result_highlight, &results[global.result_highlight]);
+  }
+  if (desc) {
       if (settings.auto_center) {
         uint32_t values[] = { global.win_x_pos_with_desc, global.win_y_pos };
         xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
@@ -606,9 +675,10 @@ void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t
 
       uint32_t new_height = min(settings.height * (global.result_count + 1), settings.max_height);
       uint32_t values[] = { settings.width+settings.desc_size, new_height };
+      check_window_size(values[0], values[1]);
       xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
       cairo_xcb_surface_set_size(surface, settings.width + settings.desc_size, new_height);
-      draw_desc(cr, results[global.result_highlight].desc, &settings.highlight_fg, &settings.highlight_bg);
+      draw_desc(cr, desc, &settings.highlight_fg, &settings.highlight_bg);
   } else {
       if (settings.auto_center) {
         uint32_t values[] = { global.win_x_pos, global.win_y_pos };
@@ -617,27 +687,39 @@ void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t
 
       uint32_t new_height = min(settings.height * (global.result_count + 1), settings.max_height);
       uint32_t values[] = { settings.width, new_height };
+      check_window_size(values[0], values[1]);
       xcb_configure_window (connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
       cairo_xcb_surface_set_size(surface, settings.width, new_height);
   }
 
   for (index = global.result_offset, line = 1; index < global.result_offset + display_results; index++, line++) {
+    int32_t highlighted = results[index].action && index == global.result_highlight;
+    if (line_is_drawn(line - 1, &results[index], highlighted)) {
+      continue;
+    }
     if (!(results[index].action)) {
       /* Title */
       draw_line(cr, results[index].text, line, &settings.result_fg, &settings.result_bg);
       /* TODO Add options for titles. */
-    } else if (index != global.result_highlight) {
+    } else if (!highlighted) {
       draw_line(cr, results[index].text, line, &settings.result_fg, &settings.result_bg);
     } else {
       draw_line(cr, results[index].text, line, &settings.highlight_fg, &settings.highlight_bg);
     }
+    set_line_drawn(line - 1, &results[index], highlighted);
   }
   cairo_surface_flush(surface);
+  trace_begin("xcb_flush");
   xcb_flush(connection);
+  trace_end("xcb_flush");
+  trace_end("draw_result_text");
 }
 
 void redraw_all(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, char *query_string, uint32_t query_cursor_index) {
+  trace_begin("redraw_all");
+  draw_invalidate();
   draw_query_text(cr, surface, query_string, query_cursor_index);
   draw_result_text(connection, window, cr, surface, global.results);
+  trace_end("redraw_all");
 }
 
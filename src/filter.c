@@ -0,0 +1,482 @@
+/** @file filter.c
+ *
+ *  @brief This file contains the built in filter: candidates are read once
+ *         (dmenu style) and fuzzy matched in process on every keystroke,
+ *         no cmd involved.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "display.h"
+#include "filter.h"
+#include "globals.h"
+
+/* @brief Scoring, in the spirit of fzf. */
+#define SCORE_MATCH           16
+#define SCORE_GAP_START       -3
+#define SCORE_GAP_EXTENSION   -1
+#define BONUS_BOUNDARY        8
+#define BONUS_CAMEL           7
+#define BONUS_CONSECUTIVE     4
+#define BONUS_FIRST_FACTOR    2
+
+/* @brief Size of the first read buffer, doubled as needed. */
+#define FILTER_BUF_SIZE       64 * 1024
+
+/* @brief A line read at startup. */
+typedef struct {
+  char *text;       /* The line itself, it's also the action. */
+  char *display;    /* The line with '%' escaped, may point to text. */
+  uint32_t length;
+} candidate_t;
+
+/* @brief A candidate that matched the last query. */
+typedef struct {
+  uint32_t index;
+  int32_t score;
+} match_t;
+
+static struct {
+  char *buf;
+  candidate_t *candidates;
+  uint32_t count;
+  match_t *matches;
+  uint32_t match_count;
+  uint32_t shown;         /* How many of the matches lead, best first. */
+  char *last_query;       /* What matches was computed for, NULL if nothing. */
+  struct result_params *params;
+} filter;
+
+typedef enum {
+  CHAR_OTHER,
+  CHAR_LOWER,
+  CHAR_UPPER,
+  CHAR_DIGIT
+} char_class_t;
+
+static inline char_class_t char_class(char c) {
+  if (c >= 'a' && c <= 'z') {
+    return CHAR_LOWER;
+  } else if (c >= 'A' && c <= 'Z') {
+    return CHAR_UPPER;
+  } else if (c >= '0' && c <= '9') {
+    return CHAR_DIGIT;
+  }
+  return CHAR_OTHER;
+}
+
+static inline char fold_char(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* @brief Finds the first occurrence of a query character.
+ *
+ * This is the prefilter: most candidates don't match and are rejected here,
+ * 16 bytes at a time, before anything is scored.
+ *
+ * @param s Where to start looking.
+ * @param end One past the last byte to look at.
+ * @param c The character, lower case if fold is set.
+ * @param fold Whether the upper case of c matches too.
+ * @return The occurrence, or NULL if there is none.
+ */
+static inline const char *find_char(const char *s, const char *end, char c, int32_t fold) {
+  char upper = (fold && char_class(c) == CHAR_LOWER) ? c - ('a' - 'A') : c;
+#ifdef __SSE2__
+  __m128i lower_vector = _mm_set1_epi8(c);
+  __m128i upper_vector = _mm_set1_epi8(upper);
+  while (s + 16 <= end) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+    __m128i found = _mm_or_si128(_mm_cmpeq_epi8(chunk, lower_vector), _mm_cmpeq_epi8(chunk, upper_vector));
+    uint32_t mask = _mm_movemask_epi8(found);
+    if (mask) {
+      return s + __builtin_ctz(mask);
+    }
+    s += 16;
+  }
+#endif
+  for (; s < end; s++) {
+    if (*s == c || *s == upper) {
+      return s;
+    }
+  }
+  return NULL;
+}
+
+/* @brief Bonus for matching the character at index i of text. */
+static inline int32_t char_bonus(const char *text, uint32_t i) {
+  char_class_t current = char_class(text[i]);
+  char_class_t previous = i ? char_class(text[i - 1]) : CHAR_OTHER;
+  if (current == CHAR_OTHER) {
+    return 0;
+  }
+  if (previous == CHAR_OTHER) {
+    return BONUS_BOUNDARY;
+  }
+  if ((previous == CHAR_LOWER && current == CHAR_UPPER)
+      || (previous != CHAR_DIGIT && current == CHAR_DIGIT)) {
+    return BONUS_CAMEL;
+  }
+  return 0;
+}
+
+/* @brief Does the work of filter_score(), with the case folding decided. */
+static int32_t score_candidate(const char *text, uint32_t length, const char *query, uint32_t query_length, int32_t fold, int32_t *score) {
+  const char *end = text + length;
+  const char *position = text;
+  uint32_t i;
+
+  /* Forward: the earliest place the whole query fits. */
+  for (i = 0; i < query_length; i++) {
+    position = find_char(position, end, query[i], fold);
+    if (!position) {
+      return -1;
+    }
+    position++;
+  }
+  if (!query_length) {
+    *score = 0;
+    return 0;
+  }
+
+  /* Backward: the latest start for that end, the tightest window. */
+  uint32_t match_end = position - text;
+  uint32_t match_start = match_end;
+  int32_t q = query_length - 1;
+  while (q >= 0) {
+    match_start--;
+    char c = fold ? fold_char(text[match_start]) : text[match_start];
+    if (c == query[q]) {
+      q--;
+    }
+  }
+
+  /* Score the window. */
+  int32_t total = 0;
+  int32_t in_gap = 0;
+  int32_t consecutive = 0;
+  q = 0;
+  for (i = match_start; i < match_end; i++) {
+    char c = fold ? fold_char(text[i]) : text[i];
+    if (q < query_length && c == query[q]) {
+      int32_t bonus = char_bonus(text, i);
+      if (consecutive) {
+        bonus += BONUS_CONSECUTIVE;
+      }
+      if (q == 0) {
+        bonus *= BONUS_FIRST_FACTOR;
+      }
+      total += SCORE_MATCH + bonus;
+      consecutive = 1;
+      in_gap = 0;
+      q++;
+    } else {
+      total += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+      consecutive = 0;
+      in_gap = 1;
+    }
+  }
+  *score = total;
+  return 0;
+}
+
+/* @brief Smart case: only a query with upper case in it is case sensitive. */
+static int32_t query_folds(const char *query, uint32_t query_length) {
+  uint32_t i;
+  for (i = 0; i < query_length; i++) {
+    if (char_class(query[i]) == CHAR_UPPER) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int32_t filter_score(const char *text, uint32_t length, const char *query, uint32_t query_length, int32_t *score) {
+  return score_candidate(text, length, query, query_length, query_folds(query, query_length), score);
+}
+
+/* @brief Best score first, then shorter candidates, then input order. */
+static int compare_matches(const void *a, const void *b) {
+  const match_t *x = a;
+  const match_t *y = b;
+  if (x->score != y->score) {
+    return x->score > y->score ? -1 : 1;
+  }
+  uint32_t x_length = filter.candidates[x->index].length;
+  uint32_t y_length = filter.candidates[y->index].length;
+  if (x_length != y_length) {
+    return x_length < y_length ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* @brief Moves a match of a min-heap down to where it belongs.
+ *
+ * @param heap The heap, the worst match first.
+ * @param count The number of matches in the heap.
+ * @param index The match to move.
+ * @return Void.
+ */
+static void heap_sift_down(match_t *heap, uint32_t count, uint32_t index) {
+  while (1) {
+    uint32_t worst = index;
+    uint32_t child = 2 * index + 1;
+    if (child < count && compare_matches(&heap[child], &heap[worst]) > 0) {
+      worst = child;
+    }
+    if (child + 1 < count && compare_matches(&heap[child + 1], &heap[worst]) > 0) {
+      worst = child + 1;
+    }
+    if (worst == index) {
+      return;
+    }
+    match_t swap = heap[index];
+    heap[index] = heap[worst];
+    heap[worst] = swap;
+    index = worst;
+  }
+}
+
+/* @brief Brings the best matches to the front of filter.matches, best first.
+ *
+ * The first ones are made a min-heap and every other match that beats the
+ * worst of them is swapped in, so the matches stay the same set (narrowing
+ * the next query needs them all) and only the leading ones get sorted.
+ *
+ * @param wanted How many matches should lead.
+ * @return Void.
+ */
+static void select_matches(uint32_t wanted) {
+  match_t *heap = filter.matches;
+  uint32_t count = wanted < filter.match_count ? wanted : filter.match_count;
+  uint32_t i;
+  for (i = count / 2; i-- > 0;) {
+    heap_sift_down(heap, count, i);
+  }
+  for (i = count; i < filter.match_count; i++) {
+    if (count && compare_matches(&filter.matches[i], &heap[0]) < 0) {
+      match_t swap = heap[0];
+      heap[0] = filter.matches[i];
+      filter.matches[i] = swap;
+      heap_sift_down(heap, count, 0);
+    }
+  }
+  /* Heapsort: the worst goes last every time, leaving the best first. */
+  for (i = count; i > 1; i--) {
+    match_t swap = heap[0];
+    heap[0] = heap[i - 1];
+    heap[i - 1] = swap;
+    heap_sift_down(heap, i - 1, 0);
+  }
+  filter.shown = count;
+}
+
+/* @brief Escapes '%' so candidates are drawn as they are. */
+static char *escape_display(char *text, uint32_t length) {
+  if (!memchr(text, '%', length)) {
+    return text;
+  }
+  char *display = malloc(2 * length + 1);
+  if (!display) {
+    return text;
+  }
+  char *out = display;
+  uint32_t i;
+  for (i = 0; i < length; i++) {
+    if (text[i] == '%') {
+      *out++ = '\\';
+    }
+    *out++ = text[i];
+  }
+  *out = '\0';
+  return display;
+}
+
+int32_t filter_load(int32_t fd, struct result_params *params) {
+  filter.params = params;
+
+  size_t size = FILTER_BUF_SIZE;
+  size_t length = 0;
+  filter.buf = malloc(size);
+  if (!filter.buf) {
+    return -1;
+  }
+  while (1) {
+    if (length + 1 >= size) {
+      char *buf = realloc(filter.buf, size * 2);
+      if (!buf) {
+        fprintf(stderr, "Couldn't allocate %zu bytes for the candidates.\n", size * 2);
+        return -1;
+      }
+      filter.buf = buf;
+      size *= 2;
+    }
+    ssize_t ret = read(fd, filter.buf + length, size - length - 1);
+    if (ret == 0) {
+      break;
+    } else if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Couldn't read the candidates: %s\n", strerror(errno));
+      return -1;
+    }
+    length += ret;
+  }
+  /* The last line may not be terminated. */
+  filter.buf[length] = '\n';
+
+  uint32_t lines = 0;
+  char *line = filter.buf;
+  char *end = filter.buf + length;
+  while (line < end && (line = memchr(line, '\n', end - line + 1))) {
+    lines++;
+    line++;
+  }
+
+  filter.candidates = malloc((lines ? lines : 1) * sizeof(candidate_t));
+  filter.matches = malloc((lines ? lines : 1) * sizeof(match_t));
+  if (!filter.candidates || !filter.matches) {
+    fprintf(stderr, "Couldn't allocate %u candidates.\n", lines);
+    return -1;
+  }
+
+  line = filter.buf;
+  while (line < end) {
+    char *newline = memchr(line, '\n', end - line + 1);
+    *newline = '\0';
+    uint32_t line_length = newline - line;
+    if (line_length) {
+      candidate_t *candidate = &filter.candidates[filter.count++];
+      candidate->text = line;
+      candidate->length = line_length;
+      candidate->display = escape_display(line, line_length);
+    }
+    line = newline + 1;
+  }
+  debug("Loaded %u candidates.\n", filter.count);
+  return 0;
+}
+
+void filter_free(void) {
+  uint32_t i;
+  for (i = 0; i < filter.count; i++) {
+    if (filter.candidates[i].display != filter.candidates[i].text) {
+      free(filter.candidates[i].display);
+    }
+  }
+  free(filter.candidates);
+  free(filter.matches);
+  free(filter.buf);
+  free(filter.last_query);
+  memset(&filter, 0, sizeof(filter));
+}
+
+/* @brief Puts the leading matches in global.results and draws them. */
+static void show_matches(void) {
+  result_t *results = malloc((filter.shown ? filter.shown : 1) * sizeof(result_t));
+  if (!results) {
+    fprintf(stderr, "Couldn't allocate %u results.\n", filter.shown);
+    return;
+  }
+  uint32_t i;
+  for (i = 0; i < filter.shown; i++) {
+    candidate_t *candidate = &filter.candidates[filter.matches[i].index];
+    results[i].text = candidate->display;
+    results[i].action = candidate->text;
+    results[i].desc = NULL;
+    results[i].score = filter.matches[i].score;
+  }
+  free(global.results);
+  global.results = results;
+  global.result_count = filter.shown;
+
+  struct result_params *params = filter.params;
+  if (global.result_count) {
+    draw_result_text(params->connection, params->window, params->cr, params->cr_surface, global.results);
+  } else {
+    /* If no result found, just draw an empty window. */
+    uint32_t values[] = { settings.width, settings.height };
+    xcb_configure_window (params->connection, params->window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+    cairo_xcb_surface_set_size(params->cr_surface, settings.width, settings.height);
+    draw_invalidate();
+  }
+}
+
+void filter_query(const char *query) {
+  uint32_t query_length = strlen(query);
+  /* A screenful to begin with, filter_scrolled() brings in more. */
+  uint32_t wanted = settings.max_height / settings.height + 1;
+  uint32_t i;
+
+  if (!query_length) {
+    /* Everything, in input order. */
+    for (i = 0; i < filter.count; i++) {
+      filter.matches[i].index = i;
+      filter.matches[i].score = 0;
+    }
+    filter.match_count = filter.count;
+    filter.shown = wanted < filter.count ? wanted : filter.count;
+  } else {
+    int32_t fold = query_folds(query, query_length);
+    char *folded = strdup(query);
+    if (!folded) {
+      return;
+    }
+    if (fold) {
+      for (i = 0; i < query_length; i++) {
+        folded[i] = fold_char(folded[i]);
+      }
+    }
+
+    /* Typing on only narrows down: whatever didn't match the last query
+     * can't match this one either (an upper case letter only makes it
+     * stricter). */
+    int32_t narrow = filter.last_query && filter.last_query[0]
+        && !strncmp(query, filter.last_query, strlen(filter.last_query));
+    uint32_t count = narrow ? filter.match_count : filter.count;
+    uint32_t matched = 0;
+    for (i = 0; i < count; i++) {
+      uint32_t index = narrow ? filter.matches[i].index : i;
+      candidate_t *candidate = &filter.candidates[index];
+      int32_t score;
+      if (!score_candidate(candidate->text, candidate->length, folded, query_length, fold, &score)) {
+        filter.matches[matched].index = index;
+        filter.matches[matched].score = score;
+        matched++;
+      }
+    }
+    filter.match_count = matched;
+    free(folded);
+    select_matches(wanted);
+  }
+
+  free(filter.last_query);
+  filter.last_query = strdup(query);
+  debug("%u of %u candidates match.\n", filter.match_count, filter.count);
+  show_matches();
+}
+
+void filter_scrolled(void) {
+  /* More are brought in once the end of the shown matches is on screen. */
+  uint32_t margin = settings.max_height / settings.height;
+  if (filter.shown == filter.match_count || global.result_highlight + margin < filter.shown) {
+    return;
+  }
+  if (filter.last_query && filter.last_query[0]) {
+    select_matches(2 * filter.shown);
+  } else {
+    /* Input order, nothing to select. */
+    filter.shown = 2 * filter.shown < filter.match_count ? 2 * filter.shown : filter.match_count;
+  }
+  show_matches();
+}
@@ -0,0 +1,76 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* @brief A block of memory allocations are carved out of. */
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+} arena_block_t;
+
+/* @brief A buffer allocated elsewhere that's freed along with the arena. */
+typedef struct arena_adopted {
+  void *buf;
+  size_t size;              /* Of a mapping, 0 for a malloc'd buffer. */
+  struct arena_adopted *next;
+} arena_adopted_t;
+
+/* @brief A bump allocator: allocations are never freed one by one, they all
+ *        go at once with the arena.  Used so a result set is a handful of
+ *        mallocs however many results it holds.
+ */
+typedef struct {
+  arena_block_t *blocks; /* The newest block, allocations come from it. */
+  arena_adopted_t *adopted;
+} arena_t;
+
+/* @brief Creates an arena.
+ *
+ * @param size How many bytes are expected to be allocated, the first block
+ *        is sized after it.
+ * @return The arena, or NULL on failure.
+ */
+arena_t *arena_new(size_t size);
+
+/* @brief Allocates memory from an arena, aligned for any type.
+ *
+ * @param arena The arena.
+ * @param size The number of bytes.
+ * @return The memory, or NULL on failure.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/* @brief Makes an arena responsible for freeing a malloc'd buffer.
+ *
+ * @param arena The arena.
+ * @param buf The buffer.
+ * @return 0 on success and -1 on failure (buf isn't freed then).
+ */
+int32_t arena_adopt(arena_t *arena, void *buf);
+
+/* @brief Makes an arena responsible for unmapping a mapping.
+ *
+ * @param arena The arena.
+ * @param addr The mapping, as returned by mmap().
+ * @param size The size of the mapping.
+ * @return 0 on success and -1 on failure (addr isn't unmapped then).
+ */
+int32_t arena_adopt_mapping(arena_t *arena, void *addr, size_t size);
+
+/* @brief Makes an arena responsible for everything allocated from (or
+ *        adopted by) another one, which is freed.  Nothing is copied, the
+ *        allocations of the other arena stay where they are.
+ *
+ * @param arena The arena.
+ * @param other The arena to take over, it can't be used anymore.
+ * @return Void.
+ */
+void arena_absorb(arena_t *arena, arena_t *other);
+
+/* @brief Frees an arena and everything allocated from it. */
+void arena_free(arena_t *arena);
+
+#endif /* _ARENA_H */
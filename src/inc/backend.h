@@ -0,0 +1,161 @@
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "debounce.h"
+#include "delta.h"
+#include "parser.h"
+#include "plugin.h"
+#include "globals.h"
+#include "isolate.h"
+#include "reader.h"
+#include "results.h"
+#include "trace.h"
+#include "writer.h"
+
+/* @brief A spawned cmd that queries are fanned out to.
+ *
+ * Each backend keeps the results of its latest answer.  Whenever one of them
+ * changes, the results of every backend are merged in configuration order
+ * into global.results, so fast backends show up without waiting for slow ones.
+ * Backends with top_k set are merged with each other by score.
+ */
+typedef struct {
+  backend_settings_t *settings;
+  protocol_t protocol;    /* The one of the settings, or the zygote's. */
+  pid_t pid;
+  int32_t from_fd;
+  int32_t to_fd;
+  writer_t writer;        /* Queries the cmd didn't read yet. */
+  int32_t write_blocked;  /* Set while waiting for the cmd to read. */
+  int32_t send_pending;   /* Set if a query waits for the writer to drain. */
+  reader_t reader;
+  debounce_t debounce;
+  int32_t debounce_timer;
+  int32_t timeout_timer;  /* Fires when the current query took too long. */
+  int32_t watchdog_timer; /* Fires when the cmd stopped responding. */
+  int32_t unanswered;     /* Set from a query written until the cmd responds. */
+  int32_t restart_timer;  /* Respawns the cmd once it's backed off. */
+  uint32_t restarts;      /* Restarts since the cmd last responded. */
+  uint32_t generation;    /* Generation of the last query written. */
+  char *sent_query;       /* The last query written. */
+  uint32_t in_flight;     /* Plain queries written but not answered yet. */
+  cache_t cache;          /* Earlier answers, shown while the cmd works. */
+  result_set_t set;       /* The results of the latest answer. */
+  parse_slot_t parse_slot; /* Answers on their way through the parser thread. */
+  plugin_t plugin;        /* Set up instead of a process for plugins. */
+  isolation_t isolation;  /* Applied to the processes spawned for the cmd. */
+  delta_t delta;          /* All the results, for PROTOCOL_DELTA. */
+  int32_t more;           /* Set if the cmd has more results to page in. */
+  int32_t page_requested; /* Set while the next page is on its way. */
+#ifdef TRACE
+  int32_t awaiting_first_byte; /* Set until the next answer starts arriving. */
+#endif
+} backend_t;
+
+/* @brief Returns whether a backend runs its script once per query, which
+ *        is also what it falls back to when its zygote died.
+ */
+#define backend_runs_script(backend) ((backend)->settings->script && (backend)->to_fd == -1)
+
+/* @brief Spawns every configured cmd and starts listening to them.
+ *
+ * @param params Used to draw results as they arrive.
+ * @param args Extra arguments (NULL terminated) for cmds with pass_args set.
+ * @return 0 if at least one cmd was started, else -1.
+ */
+int32_t backends_start(struct result_params *params, char **args);
+
+/* @brief Terminates and reaps every cmd still running, the ones that don't
+ *        exit within a grace period are killed.
+ */
+void backends_stop(void);
+
+/* @brief Sends a query to every cmd (held back while the user types fast).
+ *
+ * Cached results of the query are drawn right away, the cmd is asked anyway
+ * so they get refreshed.
+ *
+ * @param query The query, it has to stay valid until the next call.
+ * @return Void.
+ */
+void backends_query(char *query);
+
+/* @brief Asks the cmds that have more results than they sent for their
+ *        next page, once the highlight gets close to the end of what they
+ *        sent.  To be called whenever the highlight moved.
+ */
+void backends_scrolled(void);
+
+/* @brief Drops the results of every backend and global.results, without
+ *        drawing anything.
+ */
+void backends_reset(void);
+
+/* @brief Notes that a backend answered the current query, which calls off
+ *        its timeout.  Done by backend_set_results() too.
+ *
+ * @param backend The backend that answered.
+ * @return Void.
+ */
+void backend_answered(backend_t *backend);
+
+/* @brief Replaces the results of a backend, then merges and draws them.
+ *
+ * Note: the backend takes ownership of the result set.
+ *
+ * @param backend The backend that answered.
+ * @param set The parsed results.
+ * @return Void.
+ */
+void backend_set_results(backend_t *backend, result_set_t *set);
+
+/* @brief Takes a description a cmd sent on demand, and shows it if it's
+ *        the one of the highlighted result.
+ *
+ * @param line The line the cmd sent, null terminated.
+ * @param length The length of the line.
+ * @return 0 if the line is a description and -1 if it isn't.
+ */
+int32_t backend_take_description(char *line, size_t length);
+
+/* @brief Finds the result of a backend the highlight is on.
+ *
+ * @param backend The backend.
+ * @param index A reference to be populated with the index of the result
+ *        among the results of the backend.
+ * @return 0 if the highlight is on a result of the backend, else -1.
+ */
+int32_t backend_highlight(backend_t *backend, uint32_t *index);
+
+/* @brief Puts the highlight on a result of a backend, once its results are
+ *        merged.
+ *
+ * @param backend The backend.
+ * @param index The index of the result among the results of the backend.
+ * @return Void.
+ */
+void backend_set_highlight(backend_t *backend, uint32_t index);
+
+/* @brief Called whenever a backend sent something, which is as good as a
+ *        sign of life: its watchdog is called off and its backoff reset.
+ *
+ * @param backend The backend.
+ * @return Void.
+ */
+void backend_responded(backend_t *backend);
+
+/* @brief Called when a spawned process exited.  Cmds that are kept running
+ *        are restarted, with a backoff, and sent the current query again.
+ *
+ * @param pid The process that was reaped.
+ * @param status The status returned by waitpid().
+ * @return Void.
+ */
+void backend_exited(pid_t pid, int status);
+
+#endif /* _BACKEND_H */
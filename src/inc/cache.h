@@ -0,0 +1,68 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "results.h"
+
+/* @brief A cached answer of a cmd. */
+typedef struct cache_entry {
+  char *query;
+  result_set_t set;
+  uint32_t hash;
+  size_t size;              /* What the entry counts against the budget. */
+  struct cache_entry *newer;
+  struct cache_entry *older;
+  struct cache_entry *chain; /* Next entry in the same bucket. */
+} cache_entry_t;
+
+/* @brief A least recently used cache of results, keyed by query.
+ *
+ * Entries own copies of what was stored, and lookups hand out copies, so a
+ * cached set never aliases the results on screen.
+ */
+typedef struct {
+  cache_entry_t **buckets;
+  uint32_t bucket_count;
+  cache_entry_t *newest;
+  cache_entry_t *oldest;
+  size_t size;
+  size_t max_size;          /* Entries are evicted beyond this, 0 disables. */
+  uint64_t hits;
+  uint64_t misses;
+} cache_t;
+
+/* @brief Initializes a cache.
+ *
+ * @param cache The cache to be initialized.
+ * @param max_size The budget in bytes, 0 disables the cache.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t cache_init(cache_t *cache, size_t max_size);
+
+/* @brief Frees every entry of a cache. */
+void cache_free(cache_t *cache);
+
+/* @brief Stores (a copy of) the results of a query, evicting the least
+ *        recently used entries to stay within budget.
+ *
+ * @param cache The cache.
+ * @param query The query that was answered.
+ * @param set The results.
+ * @return Void.
+ */
+void cache_store(cache_t *cache, const char *query, const result_set_t *set);
+
+/* @brief Looks up the results of a query.
+ *
+ * Note: on a hit, set is a copy the caller has to free.
+ *
+ * @param cache The cache.
+ * @param query The query.
+ * @param set A reference to be populated with the results.
+ * @return 0 on a hit and -1 on a miss.
+ */
+int32_t cache_lookup(cache_t *cache, const char *query, result_set_t *set);
+
+#endif /* _CACHE_H */
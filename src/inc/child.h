@@ -3,16 +3,31 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
-/* @brief Reads from the child process's standard out in a loop.  Meant to be used
- *        as a spawned thread.
+#include "isolate.h"
+
+/* @brief Reads from the child process's standard out and draws the newest
+ *        results.  Meant to be called by the event loop when the child's
+ *        output is readable.
  *
- * @param args Immediately cast to a result_params_t type struct.  See that struct
+ * @param events The ready epoll events.
+ * @param args Immediately cast to a backend_t type struct.  See that struct
  *        for more information.
- * @return NULL.
+ * @return Void.
+ */
+void get_results(uint32_t events, void *args);
+int32_t spawn_piped_process(char **argv, int32_t use_socket, const isolation_t *isolation, pid_t *pid, int32_t *to_child_fd, int32_t *from_child_fd);
+
+/* @brief Spawns a script that is run once, in a process group of its own
+ *        (its pid is the id of the group).
+ *
+ * @param argv The arguments of the process, argv[0] is the file to execute.
+ * @param isolation Applied to the process, NULL for none.
+ * @param pid A reference to be populated with the pid of the process.
+ * @param from_child_fd The fd used to read from the process.
+ * @return 0 on success and -1 on failure.
  */
-void *get_results(void *args);
-int32_t write_to_remote(FILE *child, char *format, ...);
-int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_child_fd, char **argv);
+int32_t spawn_script(char **argv, const isolation_t *isolation, pid_t *pid, int32_t *from_child_fd);
 
 #endif /* _CHILD_H */
@@ -0,0 +1,37 @@
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+#include <stdint.h>
+
+#include "loop.h"
+
+/* @brief Starts listening for clients on the daemon socket.
+ *
+ * Every client that connects is a request to show the popup.  The client
+ * stays connected until daemon_reply() sends it the selected action.
+ *
+ * @param show Called by the event loop when a client asks for the popup.
+ * @param hide Called when a client asks for it while it's already shown.
+ * @param data Passed to the callbacks.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t daemon_listen(loop_callback_t show, loop_callback_t hide, void *data);
+
+/* @brief Stops listening and removes the socket. */
+void daemon_close(void);
+
+/* @brief Sends the selected action to the waiting client and lets it go.
+ *
+ * @param action The action to send, NULL if nothing was selected.
+ * @return Void.
+ */
+void daemon_reply(const char *action);
+
+/* @brief Asks a running daemon to show the popup and copies the selected
+ *        action to standard out.
+ *
+ * @return 0 on success and 1 on failure.
+ */
+int32_t daemon_client(void);
+
+#endif /* _DAEMON_H */
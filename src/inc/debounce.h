@@ -0,0 +1,65 @@
+#ifndef _DEBOUNCE_H
+#define _DEBOUNCE_H
+
+#include <stdint.h>
+
+/* @brief State used to decide when a query should be written to the cmd.
+ *
+ * The response time of the cmd is measured as queries are answered.  While
+ * the user types faster than the cmd can answer, intermediate queries are
+ * held back and only the newest one is sent.  A held query is never delayed
+ * by more than max_latency milliseconds.
+ */
+typedef struct {
+  uint64_t last_key;      /* When the query last changed. */
+  uint64_t last_sent;     /* When the last query was written. */
+  uint64_t pending_since; /* When the currently held query was first held. */
+  uint64_t response_time; /* Moving average of the time the cmd takes to answer. */
+  uint32_t max_latency;
+  int32_t pending;        /* Set while a query is being held back. */
+  int32_t awaiting;       /* Set while a written query is unanswered. */
+} debounce_t;
+
+/* @brief Returns a monotonic timestamp in milliseconds. */
+uint64_t debounce_now(void);
+
+/* @brief Initializes the debounce state.
+ *
+ * @param d The debounce state.
+ * @param max_latency The longest a query may be held back, 0 disables holding.
+ * @return Void.
+ */
+void debounce_init(debounce_t *d, uint32_t max_latency);
+
+/* @brief Called when the query changes.
+ *
+ * @param d The debounce state.
+ * @param now The current time.
+ * @return 1 if the query should be sent right away, else 0 (it's held back).
+ */
+int32_t debounce_key(debounce_t *d, uint64_t now);
+
+/* @brief Checks whether a held back query is due.
+ *
+ * @param d The debounce state.
+ * @param now The current time.
+ * @return 1 if the held query should be sent now, else 0.
+ */
+int32_t debounce_due(debounce_t *d, uint64_t now);
+
+/* @brief Returns how long to wait before the held query is due.
+ *
+ * @param d The debounce state.
+ * @param now The current time.
+ * @return Milliseconds until debounce_due() will return 1, or -1 if no
+ *         query is held.
+ */
+int32_t debounce_timeout(debounce_t *d, uint64_t now);
+
+/* @brief Records that a query was written. */
+void debounce_sent(debounce_t *d, uint64_t now);
+
+/* @brief Records that results were received from the cmd. */
+void debounce_response(debounce_t *d, uint64_t now);
+
+#endif /* _DEBOUNCE_H */
@@ -0,0 +1,84 @@
+#ifndef _DELTA_H
+#define _DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "results.h"
+
+/* @brief A result of a delta set, known by the id the cmd gave it. */
+typedef struct delta_entry {
+  char *data;               /* The id, text, action and desc, null separated. */
+  size_t size;              /* Bytes of data. */
+  result_t result;          /* Points into data. */
+  uint32_t hash;
+  int32_t placed;           /* Used while reordering. */
+  struct delta_entry *chain; /* Next entry in the same bucket. */
+} delta_entry_t;
+
+/* @brief The results of a cmd speaking PROTOCOL_DELTA, kept up to date by
+ *        the operations it sends (see delta_apply()).
+ */
+typedef struct {
+  delta_entry_t **buckets;  /* By id. */
+  uint32_t bucket_count;
+  delta_entry_t **order;    /* The results, in the order they're shown. */
+  uint32_t count;
+  uint32_t max;
+  size_t size;              /* Bytes of the results, without their ids. */
+  uint32_t done;            /* The last generation the set was done for. */
+} delta_t;
+
+/* @brief Initializes a delta set.
+ *
+ * @param delta The set to be initialized.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t delta_init(delta_t *delta);
+
+/* @brief Frees every result of a delta set. */
+void delta_free(delta_t *delta);
+
+/* @brief Applies an operation sent by the cmd, one of
+ *
+ *     reset <generation>
+ *     insert <generation> <id> <index> {text|action|desc}
+ *     update <generation> <id> {text|action|desc}
+ *     remove <generation> <id>
+ *     order <generation> <id> <id> ...
+ *     done <generation>
+ *
+ * Operations are applied whatever their generation, the cmd and lighthouse
+ * would disagree on the set otherwise.
+ *
+ * Note: the line is modified.
+ *
+ * @param delta The set.
+ * @param line The line holding the operation, null terminated.
+ * @param length The length of the line.
+ * @param generation A reference to be populated with the generation.
+ * @return 1 if the results changed, 0 if they didn't and -1 if the line
+ *         isn't a valid operation.
+ */
+int32_t delta_apply(delta_t *delta, char *line, size_t length, uint32_t *generation);
+
+/* @brief Copies the results of a delta set into a result set.
+ *
+ * @param delta The set.
+ * @param set The result set to be populated.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t delta_snapshot(const delta_t *delta, result_set_t *set);
+
+/* @brief Finds the index of the result with an id.
+ *
+ * @param delta The set.
+ * @param id The id.
+ * @return The index, or -1 if there is no such result.
+ */
+int32_t delta_find(const delta_t *delta, const char *id);
+
+/* @brief Returns the id of the result at an index. */
+#define delta_id(delta, index) ((const char *)(delta)->order[index]->data)
+
+#endif /* _DELTA_H */
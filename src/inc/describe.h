@@ -0,0 +1,62 @@
+#ifndef _DESCRIBE_H
+#define _DESCRIBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "results.h"
+
+/* @brief The desc of a result whose description the cmd sends on demand. */
+#define DESCRIBE_LAZY     "%?"
+
+/* @brief Returns whether a desc is only a promise of a description. */
+#define describe_is_lazy(desc) ((desc) && !strcmp((desc), DESCRIBE_LAZY))
+
+/* @brief Asks the cmd a result came from for its description.
+ *
+ * @param index The index of the result in global.results.
+ * @param id Identifies the request, the answer carries it.
+ * @param action The action of the result.
+ * @return 0 if the request was sent and -1 if the cmd can't be asked.
+ */
+typedef int32_t (*describe_request_t)(uint32_t index, uint32_t id, const char *action);
+
+/* @brief Sets up the descriptions sent on demand.
+ *
+ * @param request Used to ask for descriptions, NULL if nothing can be asked.
+ * @return Void.
+ */
+void describe_init(describe_request_t request);
+
+/* @brief Frees every description received. */
+void describe_free(void);
+
+/* @brief Returns the description to show for a result.
+ *
+ * A lazy description is asked for the first time its result is drawn with
+ * the highlight on it, and then kept by action, so moving the highlight
+ * back and forth or typing on doesn't ask again.
+ *
+ * @param index The index of the result in global.results.
+ * @param result The result.
+ * @return The description, "" while it's on its way, or NULL if there is
+ *         none.
+ */
+const char *describe_result(uint32_t index, const result_t *result);
+
+/* @brief Takes a line of the form
+ *
+ *     desc <id> <description>
+ *
+ * sent by a cmd in answer to a request.
+ *
+ * @param line The line, null terminated.
+ * @param length The length of the line.
+ * @param shown A reference to be set if the description is the one of the
+ *        highlighted result, so it has to be drawn, and unset otherwise.
+ * @return 0 if the line is a description and -1 if it isn't.
+ */
+int32_t describe_answer(const char *line, size_t length, int32_t *shown);
+
+#endif /* _DESCRIBE_H */
@@ -31,7 +31,8 @@ void redraw_all(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr,
 
 /* @brief Draw the results to the query.
  *
- * Note: the window may be resized in this function.
+ * Note: the window may be resized in this function.  Lines that already
+ * show the same result aren't drawn again.
  *
  * @param connection A connection to the Xorg server.
  * @param window An xcb window created by xcb_generate_id.
@@ -43,6 +44,11 @@ void redraw_all(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr,
  */
 void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, result_t *results);
 
+/* @brief Makes the next draw_result_text() draw every line, not only those
+ *        that changed.  Needed whenever the window lost its contents.
+ */
+void draw_invalidate(void);
+
 /* @brief Draw the query text (what is typed).
  *
  * @param cr A cairo context for drawing to the screen.
@@ -0,0 +1,57 @@
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <stdint.h>
+
+#include "results.h"
+
+/* @brief Reads the candidates to filter, one per line, until end of file.
+ *
+ * Note: this blocks, it's meant to be called once at startup.
+ *
+ * @param fd The file descriptor to read from (standard in or a file).
+ * @param params Used to draw results after every query.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t filter_load(int32_t fd, struct result_params *params);
+
+/* @brief Frees the candidates and the matches of the last query. */
+void filter_free(void);
+
+/* @brief Filters the candidates against a query, fills global.results with
+ *        the best matches (best first) and draws them.
+ *
+ * Matching is fuzzy: the characters of the query have to appear in order,
+ * case insensitively unless the query has an upper case character.
+ *
+ * @param query The query.
+ * @return Void.
+ */
+void filter_query(const char *query);
+
+/* @brief Shows more of the matches of the last query once the highlight
+ *        gets close to the end of those shown.
+ *
+ * Only a screenful of matches is ranked at first, the rest are ranked as
+ * they're scrolled to.
+ *
+ * @return Void.
+ */
+void filter_scrolled(void);
+
+/* @brief Scores how well a candidate matches a query.
+ *
+ * Every matched character scores, more so at the start of a word, on a
+ * camelCase hump or right after the previous match.  Gaps between the matched
+ * characters cost a little.
+ *
+ * @param text The candidate.
+ * @param length The length of the candidate.
+ * @param query The query.
+ * @param query_length The length of the query.
+ * @param score A reference to be populated with the score.
+ * @return 0 if the candidate matches and -1 if it doesn't.
+ */
+int32_t filter_score(const char *text, uint32_t length, const char *query, uint32_t query_length, int32_t *score);
+
+#endif /* _FILTER_H */
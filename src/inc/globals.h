@@ -1,14 +1,23 @@
 #ifndef _GLOBALS_H
 #define _GLOBALS_H
 
-#include <pthread.h>
 #include <stdint.h>
 
 #include "results.h"
 
 /* @brief Size of the buffers. */
 #define MAX_CONFIG_SIZE   10 * 1024
-#define MAX_RESULT_SIZE   10 * 1024
+#define RESULT_BUF_SIZE   10 * 1024
+#define MAX_RESULT_SIZE   16 * 1024 * 1024
+
+/* @brief Most cmds that can be configured. */
+#define MAX_BACKENDS      16
+
+/* @brief Most scripts that can run at once, whatever max_jobs says. */
+#define MAX_JOBS          64
+
+/* @brief A nice value that wasn't set. */
+#define NICE_UNSET        INT32_MIN
 
 /* @brief Debugging utilities. */
 #ifdef DEBUG
@@ -34,18 +43,61 @@ typedef struct {
   uint32_t height;
 } image_format_t;
 
+/* @brief The ways of talking to the cmd.
+ *
+ * PROTOCOL_PLAIN: queries and results are bare lines.
+ * PROTOCOL_TAGGED: queries are written as "query <generation> <text>" and
+ *     superseded ones are cancelled with "cancel <generation>".  The cmd
+ *     answers with "results <generation> <results>" so stale answers can be
+ *     dropped without being parsed.
+ * PROTOCOL_BINARY: queries are written like PROTOCOL_TAGGED, the cmd answers
+ *     with length prefixed frames (see parse_result_frame()) that are used
+ *     in place, without scanning or unescaping.
+ * PROTOCOL_DELTA: queries are written like PROTOCOL_TAGGED, the cmd answers
+ *     with operations on the results it sent before, which are known by ids
+ *     (see delta_apply()).
+ * PROTOCOL_MEMFD: queries are written like PROTOCOL_TAGGED, the cmd's
+ *     standard out is a Unix socket it passes sealed memfds holding frames
+ *     over (see memfd_map()), which are mapped and used in place.
+ */
+typedef enum {
+  PROTOCOL_PLAIN,
+  PROTOCOL_TAGGED,
+  PROTOCOL_BINARY,
+  PROTOCOL_DELTA,
+  PROTOCOL_MEMFD
+} protocol_t;
+
+/* @brief Settings of a single cmd. */
+typedef struct {
+  char *cmd;          /* Command line, expanded like a shell would. */
+  protocol_t protocol;
+  uint32_t timeout;   /* Milliseconds to wait for an answer, 0 waits forever. */
+  uint32_t watchdog;  /* Milliseconds the cmd may go without sending anything
+                       * while it owes an answer before it's restarted, 0
+                       * never restarts it. */
+  int32_t pass_args;  /* Whether lighthouse's extra arguments are passed on. */
+  int32_t plugin;     /* Whether cmd is a shared object to load instead of
+                       * a process, the protocol doesn't apply then. */
+  int32_t script;     /* Whether cmd is run once per query, with the query
+                       * as its last argument, instead of kept running. */
+  char *zygote;       /* For scripts, a zygote that runs them from a warmed
+                       * up interpreter instead, NULL if none. */
+  uint32_t top_k;     /* Most results of an answer kept, best scored first,
+                       * 0 keeps them all in order. */
+  int32_t nice;       /* Nice value of the cmd, NICE_UNSET keeps lighthouse's. */
+  int32_t ioprio;     /* I/O priority of the cmd, 0 keeps lighthouse's. */
+  char *cpu_max;      /* cpu.max of the cgroup of the cmd, NULL if none. */
+  char *memory_max;   /* memory.max of the cgroup of the cmd, NULL if none. */
+} backend_settings_t;
+
 /* @brief A struct of globals that are used throughout the program. */
 struct global_s {
-  pthread_mutex_t draw_mutex;
-  pthread_mutex_t result_mutex;
-  char result_buf[MAX_RESULT_SIZE];
-  result_t *results;
+  result_t *results; /* The results of every cmd, merged. */
   char config_buf[MAX_CONFIG_SIZE];
   uint32_t result_count;
   uint32_t result_highlight;
   uint32_t result_offset;
-  int32_t child_pid;
-  pthread_t results_thr;
   uint32_t win_x_pos;
   uint32_t win_x_pos_with_desc;
   uint32_t win_y_pos;
@@ -63,11 +115,21 @@ struct settings_s {
   color_t highlight_fg;
   color_t highlight_bg;
 
-  /* The process to pipe input to. */
-  char *cmd;
+  /* The processes to pipe input to.  Options given before any cmd apply to
+   * all of them, options given after one apply to that one only. */
+  backend_settings_t backends[MAX_BACKENDS];
+  uint32_t backend_count;
+  backend_settings_t backend_defaults;
 
   /* Options. */
   int backspace_exit;
+  uint32_t max_result_size; /* Largest result line accepted, in bytes. */
+  uint32_t debounce_max; /* Longest a query is held back while typing, in ms. */
+  uint32_t cache_size; /* Budget of the results cache, in bytes. */
+  int narrow; /* Filter the shown results locally while the cmd works. */
+  uint32_t max_jobs; /* Most scripts running at once. */
+  int32_t ui_nice; /* Nice value of lighthouse itself, NICE_UNSET keeps it. */
+  char *cgroup; /* A cgroup v2 the cgroups of cmds with limits go in. */
 
   /* Font. */
   char *font_name;
@@ -0,0 +1,65 @@
+#ifndef _ISOLATE_H
+#define _ISOLATE_H
+
+#include <stdint.h>
+
+#include "globals.h"
+
+/* @brief How a cmd is kept from competing with the UI for the CPU and the
+ *        disk, set up from its settings by isolate_init() and applied to
+ *        the cmd by isolate_apply().
+ */
+typedef struct {
+  int32_t set_nice;   /* Whether the nice value is applied at all. */
+  int32_t nice;
+  int32_t ioprio;     /* The ioprio_set() value, 0 leaves it alone. */
+  int32_t procs_fd;   /* cgroup.procs of the cgroup of the cmd, -1 if none. */
+  char *cgroup;       /* Path of that cgroup, removed by isolate_free(). */
+} isolation_t;
+
+/* @brief Parses an I/O priority setting: `idle`, `best-effort[:level]`,
+ *        `realtime[:level]` or `none`.
+ *
+ * @param val The setting.
+ * @param ioprio A reference to be populated with the ioprio_set() value.
+ * @return 0 on success and -1 if the setting is invalid.
+ */
+int32_t isolate_parse_ioprio(const char *val, int32_t *ioprio);
+
+/* @brief Sets the nice value of lighthouse itself.  Cmds without a nice
+ *        value of their own keep the one lighthouse was started with.
+ *
+ * Note: only the calling thread and the threads it starts later get it, so
+ * call it before any thread is started.
+ *
+ * @param nice The nice value.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t isolate_ui(int32_t nice);
+
+/* @brief Sets up the isolation of a cmd, creating its cgroup if it has
+ *        limits.  The cmd runs without what couldn't be set up.
+ *
+ * @param isolation The isolation to be initialized.
+ * @param backend The settings of the cmd.
+ * @param index Tells apart the cgroups of the cmds.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t isolate_init(isolation_t *isolation, const backend_settings_t *backend, uint32_t index);
+
+/* @brief Applies an isolation to the calling process.  Meant to be called
+ *        in a spawned child, before it executes the cmd.
+ *
+ * @param isolation The isolation, NULL leaves the process as it is.
+ * @return Void.
+ */
+void isolate_apply(const isolation_t *isolation);
+
+/* @brief Removes the cgroup of a cmd, once its processes were reaped.
+ *
+ * @param isolation The isolation to be freed.
+ * @return Void.
+ */
+void isolate_free(isolation_t *isolation);
+
+#endif /* _ISOLATE_H */
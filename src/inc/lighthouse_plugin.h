@@ -0,0 +1,105 @@
+#ifndef _LIGHTHOUSE_PLUGIN_H
+#define _LIGHTHOUSE_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* @brief The interface between lighthouse and backends loaded in process.
+ *
+ * A plugin is a shared object, declared in the lighthouserc with
+ *
+ *     plugin = /path/to/plugin.so arguments...
+ *
+ * that exports a lighthouse_plugin_t named lighthouse_plugin.  Queries are
+ * handed to it instead of being written to a pipe, and it answers by adding
+ * results straight to lighthouse's result set: nothing is formatted, escaped
+ * or parsed on the way.
+ *
+ * Only the version below changes when this interface changes, a plugin built
+ * against another version isn't loaded.
+ */
+#define LIGHTHOUSE_PLUGIN_ABI_VERSION 1
+
+/* @brief An answer being built, see lighthouse_host_t. */
+typedef struct lighthouse_answer lighthouse_answer_t;
+
+/* @brief What lighthouse offers a plugin.
+ *
+ * Answers may be built and sent from any thread, including from within
+ * query().  An answer belongs to the thread building it until it's sent or
+ * dropped.  Answers to superseded generations are dropped by lighthouse, so
+ * a plugin doesn't have to check.
+ */
+typedef struct {
+  uint32_t abi_version;
+
+  /* @brief Starts the answer to a query.
+   *
+   * @param host The host argument given to init().
+   * @param generation The generation of the query that is answered.
+   * @return The answer, or NULL on failure.
+   */
+  lighthouse_answer_t *(*answer_new)(void *host, uint32_t generation);
+
+  /* @brief Adds a result to an answer.  The strings are copied.
+   *
+   * @param answer The answer.
+   * @param text What's shown, with the usual % markup (nothing is escaped).
+   * @param action What's printed when the result is chosen, NULL (or "")
+   *        makes the result a title.
+   * @param desc What's shown next to the highlighted result, may be NULL.
+   * @return 0 on success and -1 on failure.
+   */
+  int32_t (*answer_add)(lighthouse_answer_t *answer, const char *text, const char *action, const char *desc);
+
+  /* @brief Shows an answer, replacing the plugin's previous results.  The
+   *        answer can't be used anymore.
+   */
+  void (*answer_send)(lighthouse_answer_t *answer);
+
+  /* @brief Throws an answer away.  The answer can't be used anymore. */
+  void (*answer_drop)(lighthouse_answer_t *answer);
+} lighthouse_host_t;
+
+/* @brief What a plugin exports, as lighthouse_plugin.
+ *
+ * Every call is made from lighthouse's event loop, so they have to return
+ * quickly: anything slow belongs on a thread of the plugin.
+ */
+typedef struct {
+  uint32_t abi_version;     /* LIGHTHOUSE_PLUGIN_ABI_VERSION. */
+
+  /* @brief Sets the plugin up, may be NULL.
+   *
+   * @param lighthouse The functions answers are built with, valid until
+   *        free() returns.
+   * @param host To be passed to answer_new().
+   * @param argc The number of arguments.
+   * @param argv The path of the plugin followed by the arguments from the
+   *        lighthouserc, only valid during the call.
+   * @param state A reference to be populated with the state the other
+   *        calls get.
+   * @return 0 on success and -1 on failure, the plugin isn't used then.
+   */
+  int32_t (*init)(const lighthouse_host_t *lighthouse, void *host, int32_t argc, char **argv, void **state);
+
+  /* @brief Asks for the results of a query.
+   *
+   * @param state The state set by init().
+   * @param generation Identifies the query, it grows with every query.
+   * @param query The query, only valid during the call.
+   * @return Void.
+   */
+  void (*query)(void *state, uint32_t generation, const char *query);
+
+  /* @brief Tells the plugin a query was superseded, may be NULL. */
+  void (*cancel)(void *state, uint32_t generation);
+
+  /* @brief Tears the plugin down, may be NULL.  Nothing may be sent from
+   *        the moment it returns, so threads of the plugin have to be
+   *        stopped by then.
+   */
+  void (*free)(void *state);
+} lighthouse_plugin_t;
+
+#endif /* _LIGHTHOUSE_PLUGIN_H */
@@ -0,0 +1,92 @@
+#ifndef _LOOP_H
+#define _LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/* @brief Called when a watched file descriptor becomes ready.
+ *
+ * @param events The epoll events that are ready (EPOLLIN, EPOLLOUT, ...).
+ *        For timers this is the number of expirations, for signals it is
+ *        the signal number.
+ * @param data The pointer given when the watch was added.
+ * @return Void.
+ */
+typedef void (*loop_callback_t)(uint32_t events, void *data);
+
+/* @brief Creates the event loop.  Must be called before anything else.
+ *
+ * @return 0 on success and -1 on failure.
+ */
+int32_t loop_init(void);
+
+/* @brief Releases the event loop and every timer and signal it created. */
+void loop_free(void);
+
+/* @brief Watches a file descriptor.
+ *
+ * @param fd The file descriptor to watch.
+ * @param events The epoll events to wait for.
+ * @param callback Called with the ready events.
+ * @param data Passed to the callback.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t loop_add(int32_t fd, uint32_t events, loop_callback_t callback, void *data);
+
+/* @brief Changes the events a watched file descriptor waits for. */
+int32_t loop_modify(int32_t fd, uint32_t events);
+
+/* @brief Stops watching a file descriptor.  The descriptor isn't closed.
+ *
+ * Note: it's safe to call this from any callback, including the fd's own.
+ */
+int32_t loop_remove(int32_t fd);
+
+/* @brief Creates a one-shot timer (a timerfd) driven by the loop.
+ *
+ * @param callback Called when the timer expires.
+ * @param data Passed to the callback.
+ * @return The timer, or -1 on failure.
+ */
+int32_t loop_timer_new(loop_callback_t callback, void *data);
+
+/* @brief Arms a timer created by loop_timer_new().
+ *
+ * @param timer The timer.
+ * @param ms Milliseconds until it expires, 0 expires as soon as possible and
+ *        a negative value disarms it.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t loop_timer_arm(int32_t timer, int32_t ms);
+
+/* @brief Delivers a signal through the loop (a signalfd) instead of
+ *        interrupting the program.  The signal is blocked.
+ *
+ * Note: processes spawned afterwards inherit the blocked mask, see
+ *       loop_unblock_signals().
+ *
+ * @param signo The signal to handle.
+ * @param callback Called once per delivered signal.
+ * @param data Passed to the callback.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t loop_signal(int32_t signo, loop_callback_t callback, void *data);
+
+/* @brief Restores the signal mask changed by loop_signal().  Meant to be
+ *        called in a forked child before exec.
+ */
+void loop_unblock_signals(void);
+
+/* @brief Sets a function called every time before the loop goes to sleep. */
+void loop_prepare(loop_callback_t callback, void *data);
+
+/* @brief Dispatches events until loop_quit() is called.
+ *
+ * @return The code passed to loop_quit(), or -1 if waiting failed.
+ */
+int32_t loop_run(void);
+
+/* @brief Makes loop_run() return once the current callback is done. */
+void loop_quit(int32_t code);
+
+#endif /* _LOOP_H */
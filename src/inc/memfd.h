@@ -0,0 +1,36 @@
+#ifndef _MEMFD_H
+#define _MEMFD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "results.h"
+
+/* @brief Receives the descriptors a cmd passed over its socket and keeps
+ *        the newest of them, the others are closed.
+ *
+ * @param socket_fd The (non-blocking) socket the cmd writes to.
+ * @param fd A reference to the newest descriptor received (closed if it's
+ *        replaced), -1 while there is none.
+ * @return Like read(): the bytes received, 0 at the end of the stream or -1
+ *         on failure.
+ */
+ssize_t memfd_receive(int32_t socket_fd, int32_t *fd);
+
+/* @brief Maps a memfd holding a result frame (see parse_result_frame()) and
+ *        parses it in place.
+ *
+ * The memfd has to be sealed against writes and shrinking, so it can't
+ * change under the results.  The mapping goes with the arena of the set.
+ *
+ * Note: fd is closed.
+ *
+ * @param fd The memfd.
+ * @param max_size The largest frame accepted.
+ * @param set The result set to be populated.
+ * @param generation A reference to be populated with the generation.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t memfd_map(int32_t fd, size_t max_size, result_set_t *set, uint32_t *generation);
+
+#endif /* _MEMFD_H */
@@ -0,0 +1,89 @@
+#ifndef _PARSER_H
+#define _PARSER_H
+
+#include <stdint.h>
+
+#include "loop.h"
+#include "results.h"
+
+/* @brief An answer of a cmd on its way through the parser thread.
+ *
+ * The job lives in the arena of its own result set, which holds the text
+ * to parse and, once parsed, the results.
+ */
+typedef struct {
+  result_set_t set;
+  uint32_t generation;  /* The generation the answer was tagged with. */
+  int32_t page;         /* Set if the results follow those already sent. */
+  int32_t more;         /* Set if the cmd has more results to page in. */
+  uint32_t top_k;       /* Most results kept, 0 keeps them all. */
+} parse_job_t;
+
+/* @brief Where jobs of one source (a backend) are handed over.
+ *
+ * Each side holds at most one job and a newer one replaces it: answers
+ * that are superseded before they're parsed or drawn are simply freed.
+ * Both pointers are only ever swapped atomically, so a job always has a
+ * single owner and neither thread ever waits for the other.
+ */
+typedef struct {
+  parse_job_t *pending; /* Set by the loop, taken by the parser thread. */
+  parse_job_t *parsed;  /* Set by the parser thread, taken by the loop. */
+} parse_slot_t;
+
+/* @brief Registers a slot, must be called before parser_start().
+ *
+ * @param slot The slot.
+ * @return 0 on success and -1 if there are too many slots.
+ */
+int32_t parser_add_slot(parse_slot_t *slot);
+
+/* @brief Starts the parser thread.
+ *
+ * @param ready Called from the event loop when parsed jobs can be taken.
+ * @param data Passed to ready.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t parser_start(loop_callback_t ready, void *data);
+
+/* @brief Stops the parser thread and frees the jobs still in the slots. */
+void parser_stop(void);
+
+/* @brief Creates a job for the text of an answer, copied into a new arena.
+ *
+ * @param text The text.
+ * @param length The length of the text.
+ * @param generation The generation the answer was tagged with.
+ * @return The job, or NULL on failure.
+ */
+parse_job_t *parser_job_new(const char *text, size_t length, uint32_t generation);
+
+/* @brief Frees a job along with its result set. */
+void parser_job_free(parse_job_t *job);
+
+/* @brief Hands a job over to the parser thread.  A job of the slot that
+ *        wasn't picked up yet is dropped.
+ *
+ * @param slot The slot.
+ * @param job The job, the parser thread owns it from now on.
+ * @return Void.
+ */
+void parser_submit(parse_slot_t *slot, parse_job_t *job);
+
+/* @brief Hands a job that needs no parsing straight to the loop, from any
+ *        thread.  A job of the slot the loop didn't take yet is dropped.
+ *
+ * @param slot The slot.
+ * @param job The job, with its results set.
+ * @return Void.
+ */
+void parser_publish(parse_slot_t *slot, parse_job_t *job);
+
+/* @brief Takes the newest parsed job of a slot.
+ *
+ * @param slot The slot.
+ * @return The job (the caller owns it), or NULL if there is none.
+ */
+parse_job_t *parser_take(parse_slot_t *slot);
+
+#endif /* _PARSER_H */
@@ -0,0 +1,42 @@
+#ifndef _PLUGIN_H
+#define _PLUGIN_H
+
+#include <stdint.h>
+
+#include "lighthouse_plugin.h"
+#include "parser.h"
+
+/* @brief A backend loaded in process (see lighthouse_plugin.h). */
+typedef struct {
+  void *handle;             /* NULL unless a plugin is loaded. */
+  const lighthouse_plugin_t *plugin;
+  void *state;
+} plugin_t;
+
+/* @brief Loads a plugin and sets it up.
+ *
+ * @param plugin The plugin to be populated.
+ * @param argv The path of the shared object followed by its arguments.
+ * @param slot Where the answers of the plugin are handed over.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t plugin_load(plugin_t *plugin, char **argv, parse_slot_t *slot);
+
+/* @brief Tears a plugin down and unloads it.  Does nothing if no plugin is
+ *        loaded.
+ */
+void plugin_unload(plugin_t *plugin);
+
+/* @brief Asks a plugin for the results of a query.
+ *
+ * @param plugin The plugin.
+ * @param generation The generation of the query.
+ * @param query The query.
+ * @return Void.
+ */
+void plugin_query(plugin_t *plugin, uint32_t generation, const char *query);
+
+/* @brief Tells a plugin a query was superseded. */
+void plugin_cancel(plugin_t *plugin, uint32_t generation);
+
+#endif /* _PLUGIN_H */
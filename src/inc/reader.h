@@ -0,0 +1,90 @@
+#ifndef _READER_H
+#define _READER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* @brief A growable receive buffer that frames records out of a byte stream.
+ *
+ * Bytes are appended with reader_fill() and complete records are taken out
+ * with reader_next() (newline terminated records) or reader_next_frame()
+ * (length prefixed records).  Every byte is searched for a terminator exactly
+ * once, no matter how many reads it took for the record to arrive.
+ */
+typedef struct {
+  char *buf;
+  size_t size;      /* Bytes allocated. */
+  size_t start;     /* Offset of the first byte not yet handed out. */
+  size_t length;    /* Offset one past the last byte read. */
+  size_t scanned;   /* Offset up to which we've searched for a newline. */
+  size_t max_size;  /* The buffer is never grown beyond this. */
+  int32_t overflow; /* Set while dropping a record larger than max_size. */
+  size_t skip;      /* Bytes left to drop of a frame larger than max_size. */
+} reader_t;
+
+/* @brief Initializes a reader.
+ *
+ * @param reader The reader to be initialized.
+ * @param max_size The largest record (in bytes) that will be accepted.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t reader_init(reader_t *reader, size_t max_size);
+
+/* @brief Frees the memory held by a reader.
+ *
+ * @param reader The reader to be freed.
+ * @return Void.
+ */
+void reader_free(reader_t *reader);
+
+/* @brief Performs a single read() from fd into the reader, growing the
+ *        buffer if needed.
+ *
+ * Note: records previously returned by reader_next() are invalidated.
+ *
+ * @param reader The reader to fill.
+ * @param fd The file descriptor to read from.
+ * @return The value returned by read().
+ */
+ssize_t reader_fill(reader_t *reader, int32_t fd);
+
+/* @brief Takes the next complete record out of the reader.
+ *
+ * The newline is replaced with a null terminator.
+ *
+ * @param reader The reader to take the record from.
+ * @param length A reference to be populated with the record length.
+ * @return The record, or NULL if no complete record is buffered.
+ */
+char *reader_next(reader_t *reader, size_t *length);
+
+/* @brief Takes the next complete length prefixed frame out of the reader.
+ *
+ * A frame is a 32 bit length in host byte order followed by that many bytes.
+ *
+ * @param reader The reader to take the frame from.
+ * @param length A reference to be populated with the frame length.
+ * @return The frame (past its length), or NULL if no complete frame is
+ *         buffered.
+ */
+char *reader_next_frame(reader_t *reader, size_t *length);
+
+/* @brief Takes every byte left in the reader out of it, whether it ends
+ *        records or not.  Meant for the end of the stream.
+ *
+ * @param reader The reader to take the bytes from.
+ * @param length A reference to be populated with the number of bytes.
+ * @return The bytes (not null terminated), or NULL if there are none.
+ */
+char *reader_rest(reader_t *reader, size_t *length);
+
+/* @brief Hands the buffer over to the caller, so the records taken out of it
+ *        can be used in place.  The bytes not taken out yet are moved to a
+ *        new buffer.
+ *
+ * @param reader The reader.
+ * @return The old buffer (free it), or NULL on failure.
+ */
+char *reader_take(reader_t *reader);
+
+#endif /* _READER_H */
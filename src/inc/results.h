@@ -7,6 +7,8 @@
 #include <pango/pangocairo.h>
 #endif
 
+#include "arena.h"
+
 /* @brief Contain everything that can be drawed.
  *  It's divided in two category:
  *      - Simple type: Just a type that draw something without variable
@@ -46,15 +48,39 @@ typedef struct {
   char *text;
   char *action;
   char *desc;
+  double score;       /* Rank given by the cmd, 0 if it gave none. */
 } result_t;
 
-/* @brief This struct is exclusively used to spawn a thread. */
+/* @brief Hashes of a result, so results can be told apart without
+ *        comparing their strings.
+ */
+typedef struct {
+  uint64_t content;   /* Of the text, the action and the description. */
+  uint64_t action;    /* Of the action alone, 0 for titles. */
+} result_hash_t;
+
+/* @brief A parsed answer of a cmd: the results, the text they point into
+ *        and the arena holding both.
+ */
+typedef struct {
+  arena_t *arena;
+  result_t *results;
+  uint32_t count;
+  char *text;
+  size_t length;      /* Length of text, it may hold null bytes. */
+  result_hash_t *hashes; /* Of each result, NULL until result_set_hash(). */
+  uint32_t capacity;  /* Results that fit before result_set_append() has
+                       * to move them, 0 if only count do. */
+  int32_t appended;   /* Set once results were appended, they don't all
+                       * point into text then. */
+} result_set_t;
+
+/* @brief Everything needed to draw results once they arrive from a cmd. */
 struct result_params {
   cairo_t *cr;
   cairo_surface_t *cr_surface;
   xcb_connection_t *connection;
   xcb_window_t window;
-  int32_t fd;
 };
 
 #ifndef NO_PANGO
@@ -62,6 +88,51 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
 #else
 draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_type_t **modifiers_array);
 #endif
-uint32_t parse_result_text(char *text, size_t length, result_t **results);
+uint32_t parse_result_text(char *text, size_t length, uint32_t top_k, result_t **results, arena_t *arena);
+int32_t parse_result_frame(char *frame, size_t length, uint32_t *generation, result_t **results, uint32_t *count, arena_t *arena);
+
+/* @brief Hashes a string (FNV-1a), NULL hashes like an empty string. */
+uint64_t hash_text(const char *text);
+
+/* @brief Hashes a result.
+ *
+ * @param result The result.
+ * @param hash The hashes to be populated.
+ * @return Void.
+ */
+void result_hash(const result_t *result, result_hash_t *hash);
+
+/* @brief Hashes every result of a set, unless they already are.  The
+ *        hashes live in the arena of the set, an empty set gets none.
+ *
+ * @param set The result set.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t result_set_hash(result_set_t *set);
+
+/* @brief Frees a result set along with its arena. */
+void result_set_free(result_set_t *set);
+
+/* @brief Copies a result set into a new arena.
+ *
+ * Note: sets that had results appended can't be copied.
+ *
+ * @param from The result set to copy.
+ * @param to The result set to be populated.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t result_set_copy(const result_set_t *from, result_set_t *to);
+
+/* @brief Appends the results of a set to another, in place.
+ *
+ * The set takes the arena of the other over, so nothing but the results
+ * themselves is copied, and their array grows geometrically: appending
+ * page after page costs time in proportion to the pages only.
+ *
+ * @param set The set to append to.
+ * @param other The results to append, emptied on success.
+ * @return 0 on success and -1 on failure (nothing changed then).
+ */
+int32_t result_set_append(result_set_t *set, result_set_t *other);
 
 #endif /* _RESULTS_H */
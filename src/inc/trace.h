@@ -0,0 +1,56 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/* @brief Where the trace is written unless LIGHTHOUSE_TRACE says otherwise. */
+#define TRACE_FILE        "/tmp/lighthouse-trace.json"
+
+/* @brief Tracing of the path from a key to the pixels it changes.
+ *
+ * Built with -DTRACE (make trace), every stage is timestamped into a file in
+ * the Chrome trace event format, to be opened with chrome://tracing or
+ * Perfetto.  Otherwise every call below compiles to nothing, arguments
+ * included.
+ */
+#ifdef TRACE
+
+/* @brief Starts writing the trace.
+ *
+ * @param file The file to write to, it is truncated.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t trace_open(const char *file);
+
+/* @brief Finishes the trace and closes the file. */
+void trace_close(void);
+
+/* @brief Marks the start of a stage on the calling thread.
+ *
+ * @param name The stage, it has to be ended with the same name.
+ * @return Void.
+ */
+void trace_begin(const char *name);
+
+/* @brief Marks the end of the innermost stage of the calling thread. */
+void trace_end(const char *name);
+
+/* @brief Marks something happening at a point in time.
+ *
+ * @param name What happened.
+ * @param detail Shown along with it, may be NULL.
+ * @return Void.
+ */
+void trace_instant(const char *name, const char *detail);
+
+#else
+
+#define trace_open(file) 0
+#define trace_close() (void)0
+#define trace_begin(name) (void)0
+#define trace_end(name) (void)0
+#define trace_instant(name, detail) (void)0
+
+#endif
+
+#endif /* _TRACE_H */
@@ -0,0 +1,56 @@
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* @brief A send buffer for a non-blocking file descriptor.
+ *
+ * Messages are appended with writer_printf() and written with writer_flush()
+ * as far as the file descriptor takes them, the rest waits for the next
+ * flush.  Nothing ever blocks on the reader of the other end.
+ */
+typedef struct {
+  char *buf;
+  size_t size;      /* Bytes allocated. */
+  size_t start;     /* Offset of the first byte not written yet. */
+  size_t length;    /* Offset one past the last byte appended. */
+} writer_t;
+
+/* @brief Initializes a writer.
+ *
+ * @param writer The writer to be initialized.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t writer_init(writer_t *writer);
+
+/* @brief Frees the memory held by a writer.
+ *
+ * @param writer The writer to be freed.
+ * @return Void.
+ */
+void writer_free(writer_t *writer);
+
+/* @brief Appends a formatted message, growing the buffer if needed.
+ *
+ * @param writer The writer.
+ * @param format The printf style format of the message.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t writer_printf(writer_t *writer, const char *format, ...);
+
+/* @brief Writes as much of the buffered messages as fd takes right now.
+ *
+ * @param writer The writer.
+ * @param fd The (non-blocking) file descriptor to write to.
+ * @return The number of bytes still buffered, or -1 on failure.
+ */
+ssize_t writer_flush(writer_t *writer, int32_t fd);
+
+/* @brief Returns the number of bytes waiting to be written. */
+#define writer_pending(writer) ((writer)->length - (writer)->start)
+
+/* @brief Drops every buffered byte. */
+#define writer_clear(writer) ((writer)->start = (writer)->length = 0)
+
+#endif /* _WRITER_H */
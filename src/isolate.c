@@ -0,0 +1,193 @@
+/** @file isolate.c
+ *
+ *  @brief This file contains the scheduling controls that keep cmds grinding
+ *         through a query from slowing down typing and drawing: nice values,
+ *         I/O priorities and cgroup v2 limits.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "isolate.h"
+
+/* @brief The I/O priority encoding of ioprio_set(2). */
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_RT     1
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_LEVELS       8
+
+/* @brief The nice value lighthouse was started with, set by isolate_ui(). */
+static int32_t base_nice;
+static int32_t ui_niced;
+
+/* @brief Writes a value to a file of a cgroup.
+ *
+ * @param dir The cgroup.
+ * @param file The name of the file.
+ * @param value The value.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t write_cgroup_file(const char *dir, const char *file, const char *value) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= (int)sizeof(path)) {
+    return -1;
+  }
+  int32_t fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  ssize_t length = strlen(value);
+  ssize_t ret = write(fd, value, length);
+  close(fd);
+  return ret == length ? 0 : -1;
+}
+
+int32_t isolate_parse_ioprio(const char *val, int32_t *ioprio) {
+  if (!strcmp(val, "none")) {
+    *ioprio = 0;
+    return 0;
+  }
+  if (!strcmp(val, "idle")) {
+    *ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    return 0;
+  }
+
+  int32_t class;
+  const char *level_start;
+  if (!strncmp(val, "best-effort", strlen("best-effort"))) {
+    class = IOPRIO_CLASS_BE;
+    level_start = val + strlen("best-effort");
+  } else if (!strncmp(val, "realtime", strlen("realtime"))) {
+    class = IOPRIO_CLASS_RT;
+    level_start = val + strlen("realtime");
+  } else {
+    return -1;
+  }
+
+  /* Levels go from 0 (highest) to 7, the kernel defaults to 4. */
+  uint32_t level = 4;
+  if (*level_start == ':') {
+    if (sscanf(level_start + 1, "%u", &level) != 1 || level >= IOPRIO_LEVELS) {
+      return -1;
+    }
+  } else if (*level_start) {
+    return -1;
+  }
+  *ioprio = (class << IOPRIO_CLASS_SHIFT) | level;
+  return 0;
+}
+
+int32_t isolate_ui(int32_t nice) {
+  errno = 0;
+  int32_t current = getpriority(PRIO_PROCESS, 0);
+  if (errno) {
+    return -1;
+  }
+  base_nice = current;
+  ui_niced = 1;
+  if (setpriority(PRIO_PROCESS, 0, nice)) {
+    /* Going below the current value takes CAP_SYS_NICE or RLIMIT_NICE. */
+    fprintf(stderr, "Couldn't set the nice value of lighthouse to %d: %s\n", nice, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+int32_t isolate_init(isolation_t *isolation, const backend_settings_t *backend, uint32_t index) {
+  memset(isolation, 0, sizeof(isolation_t));
+  isolation->procs_fd = -1;
+  isolation->set_nice = backend->nice != NICE_UNSET || ui_niced;
+  isolation->nice = backend->nice != NICE_UNSET ? backend->nice : base_nice;
+  isolation->ioprio = backend->ioprio;
+  if (!backend->cpu_max && !backend->memory_max) {
+    return 0;
+  }
+  if (!settings.cgroup) {
+    fprintf(stderr, "%s has cgroup limits but no cgroup is set, running it without them.\n", backend->cmd);
+    return -1;
+  }
+
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/lighthouse-%d-%u", settings.cgroup, (int)getpid(), index) >= (int)sizeof(path)) {
+    return -1;
+  }
+  if (mkdir(path, 0755) && errno != EEXIST) {
+    fprintf(stderr, "Couldn't create cgroup %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  /* The limits only exist once the controllers are enabled for the cgroups
+   * below settings.cgroup, which may already be the case. */
+  if (backend->cpu_max) {
+    write_cgroup_file(settings.cgroup, "cgroup.subtree_control", "+cpu");
+  }
+  if (backend->memory_max) {
+    write_cgroup_file(settings.cgroup, "cgroup.subtree_control", "+memory");
+  }
+  if ((backend->cpu_max && write_cgroup_file(path, "cpu.max", backend->cpu_max))
+      || (backend->memory_max && write_cgroup_file(path, "memory.max", backend->memory_max))) {
+    fprintf(stderr, "Couldn't set the limits of cgroup %s: %s\n", path, strerror(errno));
+    rmdir(path);
+    return -1;
+  }
+
+  char procs[PATH_MAX];
+  if (snprintf(procs, sizeof(procs), "%s/cgroup.procs", path) >= (int)sizeof(procs)) {
+    rmdir(path);
+    return -1;
+  }
+  isolation->procs_fd = open(procs, O_WRONLY | O_CLOEXEC);
+  isolation->cgroup = strdup(path);
+  if (isolation->procs_fd == -1 || !isolation->cgroup) {
+    fprintf(stderr, "Couldn't open %s: %s\n", procs, strerror(errno));
+    isolate_free(isolation);
+    return -1;
+  }
+  return 0;
+}
+
+void isolate_apply(const isolation_t *isolation) {
+  if (!isolation) {
+    return;
+  }
+  if (isolation->procs_fd != -1) {
+    /* Whatever the cmd starts is created in the cgroup too. */
+    char pid[16];
+    int length = snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    if (write(isolation->procs_fd, pid, length) != length) {
+      fprintf(stderr, "Couldn't join cgroup %s: %s\n", isolation->cgroup, strerror(errno));
+    }
+  }
+  if (isolation->set_nice && setpriority(PRIO_PROCESS, 0, isolation->nice)) {
+    fprintf(stderr, "Couldn't set nice value %d: %s\n", isolation->nice, strerror(errno));
+  }
+  if (isolation->ioprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, isolation->ioprio)) {
+    fprintf(stderr, "Couldn't set I/O priority: %s\n", strerror(errno));
+  }
+}
+
+void isolate_free(isolation_t *isolation) {
+  if (isolation->procs_fd != -1) {
+    close(isolation->procs_fd);
+  }
+  if (isolation->cgroup) {
+    /* Fails while something the cmd left behind is still running in it. */
+    if (rmdir(isolation->cgroup)) {
+      debug("Couldn't remove cgroup %s: %s\n", isolation->cgroup, strerror(errno));
+    }
+    free(isolation->cgroup);
+  }
+  memset(isolation, 0, sizeof(isolation_t));
+  isolation->procs_fd = -1;
+}
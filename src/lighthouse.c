@@ -45,10 +45,16 @@
 #include <wordexp.h>
 #include <xcb_keysyms.h>  /* xcb_key_symbols_alloc, xcb_key_press_lookup_keysym */
 
+#include "backend.h"
 #include "child.h"
+#include "daemon.h"
 #include "display.h"
+#include "filter.h"
 #include "globals.h"
+#include "isolate.h"
+#include "loop.h"
 #include "results.h"
+#include "trace.h"
 
 /* declared in <string.h>, but not unless you define a suitable macro. Not sure which macro
    (see `man strdup`) is correct for this situation. */
@@ -63,10 +69,20 @@ extern char *strdup (const char *__s);
 #define MAX_QUERY         1024
 #define HORIZ_PADDING     5
 #define CURSOR_PADDING    4
+#define DEBOUNCE_MAX      100
+#define CACHE_SIZE        1024 * 1024
+#define MAX_JOBS_DEFAULT  4
 
 /* @brief Name of the file to search for. Directory appended at runtime. */
 #define CONFIG_FILE       "/lighthouse/lighthouserc"
 
+/* @brief Set when running resident (-d), see daemon.h. */
+static int32_t daemon_mode = 0;
+
+/* @brief Where candidates are read from in filter mode (-f), "-" is standard
+ *        in.  NULL when queries go to the cmds. */
+static char *filter_file = NULL;
+
 
 /* @brief Check the xcb cookie and prints an error if it has one.
  *
@@ -219,11 +235,26 @@ static void previous_title(uint32_t *highlight) {
 }
 
 
+/* @brief Hands the selected action to whoever asked for it: standard out,
+ *        or the waiting client in daemon mode.
+ *
+ * @param action The action of the selected result.
+ * @return Void.
+ */
+static void print_action(const char *action) {
+  if (daemon_mode) {
+    daemon_reply(action);
+  } else {
+    printf("%s", action);
+  }
+}
+
 /* @brief Processes an entered key by:
  *
  * 1) Adding the key to the query buffer (backspace will remove a character).
  * 2) Drawing the updated query to the screen if necessary.
- * 3) Writing the updated query to the child process if necessary.
+ * 3) Writing the updated query to the child processes if necessary (it may be
+ *    held back while the user is typing, see debounce.h).
  *
  * @param query_buffer The string of the current query (what is typed).
  * @param query_index A reference to the current length of the query.
@@ -233,12 +264,9 @@ static void previous_title(uint32_t *highlight) {
  * @param connection A connection to the Xorg server.
  * @param cairo_context A cairo context for drawing to the screen.
  * @param cairo_surface A cairo surface for drawing to the screen.
- * @param to_write A descriptor to write to the child process.
  * @return 0 on success and 1 on failure.
  */
-static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer, uint32_t *query_index, uint32_t *query_cursor_index, xcb_keysym_t key, uint16_t modifier_mask, xcb_connection_t *connection, cairo_t *cairo_context, cairo_surface_t *cairo_surface, FILE *to_write) {
-  pthread_mutex_lock(&global.result_mutex);
-
+static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer, uint32_t *query_index, uint32_t *query_cursor_index, xcb_keysym_t key, uint16_t modifier_mask, xcb_connection_t *connection, cairo_t *cairo_context, cairo_surface_t *cairo_surface) {
   /* Check when we should update. */
   int32_t redraw = 0;
   int32_t resend = 0;
@@ -248,6 +276,7 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
   debug("key: %u, modifier: %u\n", key, mod_key);
 
   uint32_t highlight = global.result_highlight;
+  uint32_t highlight_before = global.result_highlight;
   uint32_t old_pos;
   if (global.result_count && key == 100 && mod_key == 3) {
     /* CTRL-D
@@ -265,8 +294,8 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
   switch (key) {
     case 65293: /* Enter. */
       if (global.results && global.result_highlight < global.result_count) {
-        printf("%s", global.results[global.result_highlight].action);
-        goto cleanup;
+        print_action(global.results[global.result_highlight].action);
+        return 0;
       }
       break;
     case 65471: /* F2 */
@@ -339,7 +368,7 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
       draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
       break;
     case 65307: /* Escape. */
-      goto cleanup;
+      return 0;
     case 65288: /* Backspace. */
       if (*query_index > 0 && *query_cursor_index > 0) {
           memmove(&query_buffer[(*query_cursor_index) - 1], &query_buffer[*query_cursor_index], *query_index - *query_cursor_index + 1);
@@ -349,7 +378,7 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
           redraw = 1;
           resend = 1;
       } else if (*query_index == 0 && settings.backspace_exit) { /* Backspace with nothing */
-          goto cleanup;
+          return 0;
       }
       break;
     default:
@@ -364,23 +393,30 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
   }
   }
 
+  if (global.result_highlight != highlight_before) {
+    if (filter_file) {
+      filter_scrolled();
+    } else {
+      backends_scrolled();
+    }
+  }
+
   if (redraw) {
     draw_query_text(cairo_context, cairo_surface, query_buffer, *query_cursor_index);
+    trace_begin("xcb_flush");
     xcb_flush(connection);
+    trace_end("xcb_flush");
   }
 
   if (resend) {
-    if (write_to_remote(to_write, "%s\n", query_buffer)) {
-      fprintf(stderr, "Failed to write.\n");
+    if (filter_file) {
+      filter_query(query_buffer);
+    } else {
+      backends_query(query_buffer);
     }
   }
 
-  pthread_mutex_unlock(&global.result_mutex);
   return 1;
-
-cleanup:
-  pthread_mutex_unlock(&global.result_mutex);
-  return 0;
 }
 
 /* @brief Parses a color and writes it to the settings struct.
@@ -405,6 +441,37 @@ static void set_color_setting(char* val, color_t* color) {
     return;
 }
 
+/* @brief Returns the settings cmd options apply to: the last cmd declared,
+ *        or the defaults of every cmd if none was declared yet.
+ */
+static backend_settings_t *current_backend_settings(void) {
+  if (settings.backend_count) {
+    return &settings.backends[settings.backend_count - 1];
+  }
+  return &settings.backend_defaults;
+}
+
+/* @brief Declares a new cmd in the settings.
+ *
+ * @param cmd The command line of the cmd.
+ * @param pass_args Set if the cmd gets lighthouse's extra arguments.
+ * @param plugin Set if the cmd is a plugin to load.
+ * @param script Set if the cmd is run once per query.
+ * @return Void.
+ */
+static void add_backend_setting(char *cmd, int32_t pass_args, int32_t plugin, int32_t script) {
+  if (settings.backend_count == MAX_BACKENDS) {
+    fprintf(stderr, "Too many cmds, ignoring %s.\n", cmd);
+    return;
+  }
+  backend_settings_t *backend = &settings.backends[settings.backend_count++];
+  *backend = settings.backend_defaults;
+  backend->cmd = cmd;
+  backend->pass_args = pass_args;
+  backend->plugin = plugin;
+  backend->script = script;
+}
+
 /* @brief Updates the settings global struct with the passed in parameters.
  *
  * @param param The name of the parameter to be updated.
@@ -436,8 +503,66 @@ static void set_setting(char *param, char *val) {
     sscanf(val, "%u", &settings.screen);
   } else if (!strcmp("backspace_exit", param)) {
     sscanf(val, "%d", &settings.backspace_exit);
-  } else if (!strcmp("cmd", param)) {
-    settings.cmd = val;
+  } else if (!strcmp("max_result_size", param)) {
+    sscanf(val, "%u", &settings.max_result_size);
+  } else if (!strcmp("debounce_max", param)) {
+    sscanf(val, "%u", &settings.debounce_max);
+  } else if (!strcmp("cache_size", param)) {
+    sscanf(val, "%u", &settings.cache_size);
+  } else if (!strcmp("narrow", param)) {
+    sscanf(val, "%d", &settings.narrow);
+  } else if (!strcmp("cmd", param) || !strcmp("backend", param)) {
+    add_backend_setting(val, !strcmp("cmd", param), 0, 0);
+  } else if (!strcmp("plugin", param)) {
+    add_backend_setting(val, 1, 1, 0);
+  } else if (!strcmp("script", param)) {
+    add_backend_setting(val, 0, 0, 1);
+  } else if (!strcmp("max_jobs", param)) {
+    sscanf(val, "%u", &settings.max_jobs);
+    if (settings.max_jobs > MAX_JOBS) {
+      settings.max_jobs = MAX_JOBS;
+    } else if (!settings.max_jobs) {
+      /* Scripts would never run. */
+      settings.max_jobs = 1;
+    }
+  } else if (!strcmp("protocol", param)) {
+    backend_settings_t *backend = current_backend_settings();
+    if (!strcmp("tagged", val)) {
+      backend->protocol = PROTOCOL_TAGGED;
+    } else if (!strcmp("binary", val)) {
+      backend->protocol = PROTOCOL_BINARY;
+    } else if (!strcmp("delta", val)) {
+      backend->protocol = PROTOCOL_DELTA;
+    } else if (!strcmp("memfd", val)) {
+      backend->protocol = PROTOCOL_MEMFD;
+    } else if (!strcmp("plain", val)) {
+      backend->protocol = PROTOCOL_PLAIN;
+    } else {
+      fprintf(stderr, "Unknown protocol %s, using plain.\n", val);
+      backend->protocol = PROTOCOL_PLAIN;
+    }
+  } else if (!strcmp("timeout", param)) {
+    sscanf(val, "%u", &current_backend_settings()->timeout);
+  } else if (!strcmp("watchdog", param)) {
+    sscanf(val, "%u", &current_backend_settings()->watchdog);
+  } else if (!strcmp("top_k", param)) {
+    sscanf(val, "%u", &current_backend_settings()->top_k);
+  } else if (!strcmp("zygote", param)) {
+    current_backend_settings()->zygote = val;
+  } else if (!strcmp("nice", param)) {
+    sscanf(val, "%d", &current_backend_settings()->nice);
+  } else if (!strcmp("ioprio", param)) {
+    if (isolate_parse_ioprio(val, &current_backend_settings()->ioprio)) {
+      fprintf(stderr, "Unknown I/O priority %s, ignoring it.\n", val);
+    }
+  } else if (!strcmp("cpu_max", param)) {
+    current_backend_settings()->cpu_max = val;
+  } else if (!strcmp("memory_max", param)) {
+    current_backend_settings()->memory_max = val;
+  } else if (!strcmp("ui_nice", param)) {
+    sscanf(val, "%d", &settings.ui_nice);
+  } else if (!strcmp("cgroup", param)) {
+    settings.cgroup = val;
   } else if (!strcmp("query_fg", param)) {
       set_color_setting(val, &settings.query_fg);
   } else if (!strcmp("query_bg", param)) {
@@ -589,6 +714,20 @@ static int initialize_settings(char *config_file) {
   settings.desktop = 0xFFFFFFFF;
   settings.screen = 0;
   settings.backspace_exit = 1;
+  settings.max_result_size = MAX_RESULT_SIZE;
+  settings.debounce_max = DEBOUNCE_MAX;
+  settings.cache_size = CACHE_SIZE;
+  settings.narrow = 0;
+  settings.max_jobs = MAX_JOBS_DEFAULT;
+  settings.ui_nice = NICE_UNSET;
+  settings.cgroup = NULL;
+  settings.backend_count = 0;
+  settings.backend_defaults.protocol = PROTOCOL_PLAIN;
+  settings.backend_defaults.timeout = 0;
+  settings.backend_defaults.watchdog = 0;
+  settings.backend_defaults.top_k = 0;
+  settings.backend_defaults.nice = NICE_UNSET;
+  settings.backend_defaults.ioprio = 0;
   settings.dock_mode = 1;
   settings.desc_size = 300;
   settings.auto_center = 1;
@@ -646,10 +785,146 @@ static int initialize_settings(char *config_file) {
  * @return Void.
  */
 void kill_zombie(void) {
-  kill(global.child_pid, SIGTERM);
-  while(wait(NULL) == -1);
+  backends_stop();
+}
+
+/* @brief State handed to the event loop callbacks in this file. */
+struct event_params {
+  xcb_connection_t *connection;
+  xcb_window_t window;
+  xcb_key_symbols_t *keysyms;
+  cairo_t *cr;
+  cairo_surface_t *cr_surface;
+  char *query_string;
+  uint32_t *query_index;
+  uint32_t *query_cursor_index;
+};
+
+/* @brief Hides the popup in daemon mode, letting the waiting client go
+ *        empty handed if it hasn't been answered yet.
+ *
+ * @param events Unused.
+ * @param args Immediately cast to a struct event_params.
+ * @return Void.
+ */
+static void hide_popup(uint32_t events, void *args) {
+  struct event_params *params = args;
+  daemon_reply(NULL);
+  xcb_unmap_window(params->connection, params->window);
+  xcb_flush(params->connection);
+}
+
+/* @brief Shows the popup in daemon mode with an empty query, as if
+ *        lighthouse was just started.
+ *
+ * @param events Unused.
+ * @param args Immediately cast to a struct event_params.
+ * @return Void.
+ */
+static void show_popup(uint32_t events, void *args) {
+  struct event_params *params = args;
+  memset(params->query_string, 0, MAX_QUERY);
+  *params->query_index = 0;
+  *params->query_cursor_index = 0;
+  global.result_highlight = 0;
+  global.result_offset = 0;
+  backends_reset();
+
+  xcb_map_window(params->connection, params->window);
+  uint32_t values[] = { settings.auto_center ? global.win_x_pos : global.win_x_pos_with_desc, global.win_y_pos };
+  xcb_configure_window(params->connection, params->window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+  redraw_all(params->connection, params->window, params->cr, params->cr_surface, params->query_string, 0);
+  if (filter_file) {
+    filter_query(params->query_string);
+  }
+  xcb_flush(params->connection);
+}
+
+/* @brief Stops the daemon on SIGTERM or SIGINT so it can clean up. */
+static void handle_quit_signal(uint32_t signo, void *args) {
+  loop_quit(0);
+}
+
+/* @brief Handles every X event waiting on the connection.  Called by the
+ *        event loop when the connection is readable and before it sleeps,
+ *        as other xcb calls may have queued events without the fd waking us.
+ *
+ * @param events The ready epoll events (unused).
+ * @param args Immediately cast to a struct event_params.
+ * @return Void.
+ */
+static void handle_x_events(uint32_t events, void *args) {
+  struct event_params *params = args;
+  xcb_connection_t *connection = params->connection;
+  xcb_window_t window = params->window;
+  xcb_generic_event_t *event;
+
+  while ((event = xcb_poll_for_event(connection))) {
+    switch (event->response_type & ~0x80) {
+      case XCB_EXPOSE: {
+        /* Get the input focus. */
+        xcb_void_cookie_t focus_cookie = xcb_set_input_focus_checked(connection, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
+        check_xcb_cookie(focus_cookie, connection, "Failed to grab focus.");
+
+        /* Redraw. */
+        redraw_all(connection, window, params->cr, params->cr_surface, params->query_string, *params->query_cursor_index);
+        break;
+      }
+      case XCB_KEY_PRESS: {
+        break;
+      }
+      case XCB_KEY_RELEASE: {
+        xcb_key_release_event_t *k = (xcb_key_release_event_t *)event;
+        xcb_keysym_t key = xcb_key_press_lookup_keysym(params->keysyms, k, k->state & ~XCB_MOD_MASK_2 & ~XCB_MOD_MASK_CONTROL);
+        trace_instant("key", NULL);
+        trace_begin("process_key_stroke");
+        int32_t ret = process_key_stroke(window, params->query_string, params->query_index, params->query_cursor_index, key, k->state, connection, params->cr, params->cr_surface);
+        trace_end("process_key_stroke");
+        if (ret <= 0) {
+          if (daemon_mode) {
+            /* Stay around for the next time, the event is freed below. */
+            hide_popup(0, params);
+            break;
+          }
+          free(event);
+          loop_quit(ret);
+          return;
+        }
+        break;
+      }
+      case XCB_EVENT_MASK_BUTTON_PRESS: {
+        /* Get the input focus. */
+        xcb_void_cookie_t focus_cookie = xcb_set_input_focus_checked(connection, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
+        check_xcb_cookie(focus_cookie, connection, "Failed to grab focus.");
+        break;
+      }
+      default:
+        break;
+    }
+
+    free(event);
+  }
+
+  if (xcb_connection_has_error(connection)) {
+    loop_quit(0);
+    return;
+  }
+  xcb_flush(connection);
 }
 
+/* @brief Reaps the child processes when they exit.
+ *
+ * @param signo The signal number (SIGCHLD).
+ * @param args Unused.
+ * @return Void.
+ */
+static void handle_child_exit(uint32_t signo, void *args) {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    backend_exited(pid, status);
+  }
+}
 
 
 /* @brief The main function. Initialization happens here.
@@ -668,11 +943,21 @@ int main(int argc, char **argv) {
   }
   sprintf(config_file, "%s%s", config_file_dir, CONFIG_FILE);
   int c;
-  while ((c = getopt(argc, argv, "c:")) != -1) {
+  while ((c = getopt(argc, argv, "c:dsf:")) != -1) {
     switch (c) {
       case 'c':
         config_file = strdup(optarg);
         break;
+      case 'd':
+        daemon_mode = 1;
+        break;
+      case 'f':
+        filter_file = optarg;
+        break;
+      case 's':
+        /* Thin client, the daemon does all the work. */
+        free(config_file);
+        return daemon_client();
       default:
         break;
     }
@@ -702,24 +987,55 @@ int main(int argc, char **argv) {
 
   cmdargs[nargs - 1] = NULL;
 
-  /* Set up the remote process. */
-  int32_t to_child_fd, from_child_fd;
+  /* Only does anything when built with tracing. */
+  if (trace_open(getenv("LIGHTHOUSE_TRACE") ? getenv("LIGHTHOUSE_TRACE") : TRACE_FILE)) {
+    return 1;
+  }
 
-  char *exec_file = settings.cmd;
+  /* Before any thread is started, threads take the nice value of the one
+   * that started them. */
+  if (settings.ui_nice != NICE_UNSET) {
+    isolate_ui(settings.ui_nice);
+  }
 
-  if (spawn_piped_process(exec_file, &to_child_fd, &from_child_fd, (char **)cmdargs)) {
+  /* Everything is driven by the event loop, child exits included. */
+  if (loop_init() || loop_signal(SIGCHLD, handle_child_exit, NULL)) {
+    return 1;
+  }
+
+  /* A cmd that died must not take us down with it on the next write. */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* Set up the remote processes.  They're started before anything else so
+   * they can warm up while we talk to X, results_params is filled in below. */
+  struct result_params results_params;
+  if (filter_file) {
+    /* No cmd needed, the candidates are filtered right here. */
+    int32_t fd = strcmp(filter_file, "-") ? open(filter_file, O_RDONLY) : STDIN_FILENO;
+    if (fd == -1) {
+      fprintf(stderr, "Couldn't open %s.\n", filter_file);
+      return 1;
+    }
+    int32_t ret = filter_load(fd, &results_params);
+    if (fd != STDIN_FILENO) {
+      close(fd);
+    }
+    if (ret) {
+      return 1;
+    }
+  } else if (!settings.backend_count) {
+    fprintf(stderr, "No cmd set in the configuration file.\n");
+    return 1;
+  } else if (backends_start(&results_params, &cmdargs[1])) {
     fprintf(stderr, "Failed to spawn piped process.\n");
     exit_code = 1;
     return exit_code;
   }
 
-  /* Don't free #0, it is filled in by spawn_piped_process() and isn't memory that we own */
+  /* #0 is never filled in, the cmd's own name goes there. */
   for (i=1; i < nargs - 1 ; i++)
     free(cmdargs[i]);
 
-  /* The main way to communicate with our remote process. */
-  FILE *to_child = fdopen(to_child_fd, "w");
-
   /* Connect to the X server. */
   xcb_connection_t *connection = xcb_connect(NULL, NULL);
 
@@ -864,31 +1180,17 @@ int main(int argc, char **argv) {
   global.real_desc_font_size = extents.height;
   debug("%u to %f\n", settings.desc_font_size, global.real_desc_font_size);
 
-  /* Spawn a thread to listen to our remote process. */
-  if (pthread_mutex_init(&global.draw_mutex, NULL)) {
-    fprintf(stderr, "Failed to create mutex.");
-    goto cleanup;
-  }
-
-  if (pthread_mutex_init(&global.result_mutex, NULL)) {
-    fprintf(stderr, "Failed to create mutex.");
-    goto cleanup;
-  }
-
-  struct result_params results_thr_params;
-  results_thr_params.fd = from_child_fd;
-  results_thr_params.cr = cairo_context;
-  results_thr_params.cr_surface = cairo_surface;
-  results_thr_params.connection = connection;
-  results_thr_params.window = window;
+  /* Results can be drawn now. */
+  results_params.cr = cairo_context;
+  results_params.cr_surface = cairo_surface;
+  results_params.connection = connection;
+  results_params.window = window;
 
-  if (pthread_create(&global.results_thr, NULL, &get_results, &results_thr_params)) {
-    fprintf(stderr, "Couldn't spawn second thread: %s\n", strerror(errno));
-    exit(1);
+  /* A daemon waits for a client before showing up. */
+  if (!daemon_mode) {
+    xcb_map_window(connection, window);
   }
 
-  xcb_map_window(connection, window);
-
   /* Query string. */
   char query_string[MAX_QUERY];
   memset(query_string, 0, sizeof(query_string));
@@ -915,49 +1217,46 @@ int main(int argc, char **argv) {
   }
   xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
 
-  xcb_generic_event_t *event;
-  while ((event = xcb_wait_for_event(connection))) {
-    switch (event->response_type & ~0x80) {
-      case XCB_EXPOSE: {
-        /* Get the input focus. */
-        xcb_void_cookie_t focus_cookie = xcb_set_input_focus_checked(connection, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
-        check_xcb_cookie(focus_cookie, connection, "Failed to grab focus.");
-
-        /* Redraw. */
-        redraw_all(connection, window, cairo_context, cairo_surface, query_string, query_cursor_index);
-        break;
-      }
-      case XCB_KEY_PRESS: {
-        break;
-      }
-      case XCB_KEY_RELEASE: {
-        xcb_key_release_event_t *k = (xcb_key_release_event_t *)event;
-        xcb_keysym_t key = xcb_key_press_lookup_keysym(keysyms, k, k->state & ~XCB_MOD_MASK_2 & ~XCB_MOD_MASK_CONTROL);
-        int32_t ret = process_key_stroke(window, query_string, &query_index, &query_cursor_index, key, k->state, connection, cairo_context, cairo_surface, to_child);
-        if (ret <= 0) {
-          exit_code = ret;
-          goto cleanup;
-        }
-        break;
-      }
-      case XCB_EVENT_MASK_BUTTON_PRESS: {
-        /* Get the input focus. */
-        xcb_void_cookie_t focus_cookie = xcb_set_input_focus_checked(connection, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
-        check_xcb_cookie(focus_cookie, connection, "Failed to grab focus.");
-        break;
-      }
-      default:
-        break;
-    }
+  /* Like dmenu, start with every candidate. */
+  if (filter_file) {
+    filter_query(query_string);
+  }
 
-    free(event);
+  /* Hand everything over to the event loop. */
+  struct event_params event_params;
+  event_params.connection = connection;
+  event_params.window = window;
+  event_params.keysyms = keysyms;
+  event_params.cr = cairo_context;
+  event_params.cr_surface = cairo_surface;
+  event_params.query_string = query_string;
+  event_params.query_index = &query_index;
+  event_params.query_cursor_index = &query_cursor_index;
+
+  if (loop_add(xcb_get_file_descriptor(connection), EPOLLIN, handle_x_events, &event_params)) {
+    exit_code = 1;
+  } else if (daemon_mode && (daemon_listen(show_popup, hide_popup, &event_params)
+      || loop_signal(SIGTERM, handle_quit_signal, NULL)
+      || loop_signal(SIGINT, handle_quit_signal, NULL))) {
+    exit_code = 1;
+  } else {
+    loop_prepare(handle_x_events, &event_params);
+    exit_code = loop_run();
   }
 
+  if (daemon_mode) {
+    daemon_close();
+  }
+  if (filter_file) {
+    filter_free();
+  }
   cairo_surface_destroy(cairo_surface);
   cairo_destroy(cairo_context);
 
 cleanup:
+  loop_free();
   xcb_disconnect(connection);
   xcb_key_symbols_free(keysyms);
+  trace_close();
   return exit_code;
 }
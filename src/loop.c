@@ -0,0 +1,287 @@
+/** @file loop.c
+ *
+ *  @brief This file contains the event loop that drives lighthouse: the X
+ *         connection, the pipes of the spawned process, timers and signals
+ *         are all waited on here, from a single thread.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "loop.h"
+
+/* @brief How many ready events are taken out of epoll at a time. */
+#define MAX_EVENTS        16
+/* @brief Signals above this can't be handled by the loop. */
+#define MAX_SIGNAL        64
+
+typedef enum {
+  WATCH_FD,
+  WATCH_TIMER,
+  WATCH_SIGNAL
+} watch_type_t;
+
+/* @brief Something the loop is waiting on. */
+typedef struct watch {
+  int32_t fd;
+  watch_type_t type;
+  loop_callback_t callback;
+  void *data;
+  int32_t removed; /* Freed after the current batch of events. */
+  struct watch *next;
+} watch_t;
+
+static struct {
+  int32_t epoll_fd;
+  int32_t signal_fd;
+  watch_t *watches;
+  sigset_t signals;
+  sigset_t old_mask;
+  loop_callback_t signal_callbacks[MAX_SIGNAL + 1];
+  void *signal_data[MAX_SIGNAL + 1];
+  loop_callback_t prepare;
+  void *prepare_data;
+  int32_t running;
+  int32_t code;
+} loop = { -1, -1 };
+
+/* @brief Finds the live watch of a file descriptor. */
+static watch_t *find_watch(int32_t fd) {
+  watch_t *watch;
+  for (watch = loop.watches; watch; watch = watch->next) {
+    if (watch->fd == fd && !watch->removed) {
+      return watch;
+    }
+  }
+  return NULL;
+}
+
+static int32_t add_watch(int32_t fd, uint32_t events, watch_type_t type, loop_callback_t callback, void *data) {
+  watch_t *watch = calloc(1, sizeof(watch_t));
+  if (!watch) {
+    return -1;
+  }
+  watch->fd = fd;
+  watch->type = type;
+  watch->callback = callback;
+  watch->data = data;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = watch;
+  if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+    fprintf(stderr, "Couldn't watch fd %d: %s\n", fd, strerror(errno));
+    free(watch);
+    return -1;
+  }
+
+  watch->next = loop.watches;
+  loop.watches = watch;
+  return 0;
+}
+
+/* @brief Frees the watches removed since the last call. */
+static void sweep_watches(void) {
+  watch_t **watch = &loop.watches;
+  while (*watch) {
+    if ((*watch)->removed) {
+      watch_t *removed = *watch;
+      *watch = removed->next;
+      free(removed);
+    } else {
+      watch = &(*watch)->next;
+    }
+  }
+}
+
+int32_t loop_init(void) {
+  loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop.epoll_fd == -1) {
+    fprintf(stderr, "Couldn't create the event loop: %s\n", strerror(errno));
+    return -1;
+  }
+  sigemptyset(&loop.signals);
+  sigprocmask(SIG_BLOCK, NULL, &loop.old_mask);
+  return 0;
+}
+
+void loop_free(void) {
+  watch_t *watch;
+  for (watch = loop.watches; watch; watch = watch->next) {
+    if (!watch->removed && watch->type == WATCH_TIMER) {
+      close(watch->fd);
+    }
+    watch->removed = 1;
+  }
+  sweep_watches();
+  if (loop.signal_fd != -1) {
+    close(loop.signal_fd);
+    loop.signal_fd = -1;
+  }
+  if (loop.epoll_fd != -1) {
+    close(loop.epoll_fd);
+    loop.epoll_fd = -1;
+  }
+}
+
+int32_t loop_add(int32_t fd, uint32_t events, loop_callback_t callback, void *data) {
+  return add_watch(fd, events, WATCH_FD, callback, data);
+}
+
+int32_t loop_modify(int32_t fd, uint32_t events) {
+  watch_t *watch = find_watch(fd);
+  if (!watch) {
+    return -1;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = watch;
+  return epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+int32_t loop_remove(int32_t fd) {
+  watch_t *watch = find_watch(fd);
+  if (!watch) {
+    return -1;
+  }
+  /* The watch may still be referenced by the batch being dispatched, so
+   * only mark it here. */
+  watch->removed = 1;
+  return epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int32_t loop_timer_new(loop_callback_t callback, void *data) {
+  int32_t timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer == -1) {
+    fprintf(stderr, "Couldn't create a timer: %s\n", strerror(errno));
+    return -1;
+  }
+  if (add_watch(timer, EPOLLIN, WATCH_TIMER, callback, data)) {
+    close(timer);
+    return -1;
+  }
+  return timer;
+}
+
+int32_t loop_timer_arm(int32_t timer, int32_t ms) {
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (ms > 0) {
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+  } else if (ms == 0) {
+    /* A zero it_value would disarm the timer. */
+    spec.it_value.tv_nsec = 1;
+  }
+  return timerfd_settime(timer, 0, &spec, NULL);
+}
+
+int32_t loop_signal(int32_t signo, loop_callback_t callback, void *data) {
+  if (signo <= 0 || signo > MAX_SIGNAL) {
+    return -1;
+  }
+  loop.signal_callbacks[signo] = callback;
+  loop.signal_data[signo] = data;
+
+  sigaddset(&loop.signals, signo);
+  if (sigprocmask(SIG_BLOCK, &loop.signals, NULL)) {
+    return -1;
+  }
+
+  int32_t first = loop.signal_fd == -1;
+  loop.signal_fd = signalfd(loop.signal_fd, &loop.signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (loop.signal_fd == -1) {
+    fprintf(stderr, "Couldn't create a signalfd: %s\n", strerror(errno));
+    return -1;
+  }
+  if (first) {
+    return add_watch(loop.signal_fd, EPOLLIN, WATCH_SIGNAL, NULL, NULL);
+  }
+  return 0;
+}
+
+void loop_unblock_signals(void) {
+  sigprocmask(SIG_SETMASK, &loop.old_mask, NULL);
+}
+
+void loop_prepare(loop_callback_t callback, void *data) {
+  loop.prepare = callback;
+  loop.prepare_data = data;
+}
+
+/* @brief Reads the pending signals and calls their callbacks. */
+static void dispatch_signals(int32_t fd) {
+  struct signalfd_siginfo info;
+  while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+    uint32_t signo = info.ssi_signo;
+    if (signo <= MAX_SIGNAL && loop.signal_callbacks[signo]) {
+      loop.signal_callbacks[signo](signo, loop.signal_data[signo]);
+    }
+  }
+}
+
+int32_t loop_run(void) {
+  struct epoll_event events[MAX_EVENTS];
+  loop.running = 1;
+  loop.code = 0;
+
+  while (loop.running) {
+    if (loop.prepare) {
+      loop.prepare(0, loop.prepare_data);
+      if (!loop.running) {
+        break;
+      }
+    }
+
+    int32_t count = epoll_wait(loop.epoll_fd, events, MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Failed to wait for events: %s\n", strerror(errno));
+      return -1;
+    }
+
+    int32_t i;
+    for (i = 0; i < count && loop.running; i++) {
+      watch_t *watch = events[i].data.ptr;
+      if (watch->removed) {
+        continue;
+      }
+      switch (watch->type) {
+        case WATCH_TIMER: {
+          uint64_t expirations;
+          if (read(watch->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            watch->callback(expirations, watch->data);
+          }
+          break;
+        }
+        case WATCH_SIGNAL:
+          dispatch_signals(watch->fd);
+          break;
+        case WATCH_FD:
+        default:
+          watch->callback(events[i].events, watch->data);
+          break;
+      }
+    }
+    sweep_watches();
+  }
+  return loop.code;
+}
+
+void loop_quit(int32_t code) {
+  loop.code = code;
+  loop.running = 0;
+}
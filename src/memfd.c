@@ -0,0 +1,112 @@
+/** @file memfd.c
+ *
+ *  @brief This file contains the transport where cmds hand result sets over
+ *         as sealed memfds instead of writing them to a pipe.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memfd.h"
+#include "trace.h"
+
+/* @brief Most descriptors taken out of a single message. */
+#define MEMFD_MAX_FDS     8
+
+/* @brief The seals a memfd needs for its contents to be fixed. */
+#define MEMFD_SEALS       (F_SEAL_SHRINK | F_SEAL_WRITE)
+
+ssize_t memfd_receive(int32_t socket_fd, int32_t *fd) {
+  ssize_t total = 0;
+  while (1) {
+    char data[256];
+    char control[CMSG_SPACE(MEMFD_MAX_FDS * sizeof(int))];
+    struct iovec iov = { data, sizeof(data) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t ret = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return total ? total : ret;
+    }
+    total += ret;
+
+    struct cmsghdr *header;
+    for (header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+      if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      size_t i, count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (i = 0; i < count; i++) {
+        /* Only the newest answer matters, older ones are already stale. */
+        if (*fd != -1) {
+          close(*fd);
+        }
+        memcpy(fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+      }
+    }
+    if (message.msg_flags & MSG_CTRUNC) {
+      fprintf(stderr, "Descriptors were dropped, too many sent at once.\n");
+    }
+  }
+}
+
+int32_t memfd_map(int32_t fd, size_t max_size, result_set_t *set, uint32_t *generation) {
+  memset(set, 0, sizeof(result_set_t));
+  struct stat info;
+  int32_t seals = fcntl(fd, F_GET_SEALS);
+  if (seals == -1 || (seals & MEMFD_SEALS) != MEMFD_SEALS) {
+    fprintf(stderr, "Result memfd isn't sealed against writes and shrinking.\n");
+    close(fd);
+    return -1;
+  }
+  if (fstat(fd, &info) || !info.st_size || (size_t)info.st_size > max_size) {
+    fprintf(stderr, "Result memfd of unusable size.\n");
+    close(fd);
+    return -1;
+  }
+
+  /* A private mapping, so the results may be written to like any others
+   * without touching the memfd. */
+  size_t size = info.st_size;
+  char *frame = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (frame == MAP_FAILED) {
+    fprintf(stderr, "Couldn't map a result memfd: %s\n", strerror(errno));
+    return -1;
+  }
+
+  set->arena = arena_new(size / 16);
+  if (!set->arena || arena_adopt_mapping(set->arena, frame, size)) {
+    munmap(frame, size);
+    result_set_free(set);
+    return -1;
+  }
+  trace_begin("parse_result_frame");
+  int32_t ret = parse_result_frame(frame, size, generation, &set->results, &set->count, set->arena);
+  trace_end("parse_result_frame");
+  if (ret) {
+    result_set_free(set);
+    return -1;
+  }
+  /* The frame ends with the null byte of its last field. */
+  set->text = frame;
+  set->length = size - 1;
+  return 0;
+}
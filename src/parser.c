@@ -0,0 +1,206 @@
+/** @file parser.c
+ *
+ *  @brief This file contains the thread results are parsed on, so a large
+ *         answer never holds up the event loop (and the keys it handles).
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "parser.h"
+#include "trace.h"
+
+static struct {
+  parse_slot_t *slots[MAX_BACKENDS];
+  uint32_t slot_count;
+  pthread_t thread;
+  int32_t running;
+  int32_t quit;           /* Tells the parser thread to return. */
+  int32_t work_fd;        /* Wakes the parser thread up. */
+  int32_t ready_fd;       /* Wakes the event loop up. */
+  loop_callback_t ready;
+  void *ready_data;
+} parser = { .work_fd = -1, .ready_fd = -1 };
+
+/* @brief Bumps an eventfd. */
+static void wake(int32_t fd) {
+  uint64_t one = 1;
+  while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+/* @brief Parses whatever the loop submitted, until told to quit. */
+static void *parser_thread(void *args) {
+  /* Signals are for the loop's signalfd, never for this thread. */
+  sigset_t signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  while (1) {
+    uint64_t count;
+    if (read(parser.work_fd, &count, sizeof(count)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Parser thread failed to wait: %s\n", strerror(errno));
+      break;
+    }
+    if (__atomic_load_n(&parser.quit, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+
+    int32_t published = 0;
+    uint32_t i;
+    for (i = 0; i < parser.slot_count; i++) {
+      parse_slot_t *slot = parser.slots[i];
+      parse_job_t *job = __atomic_exchange_n(&slot->pending, NULL, __ATOMIC_ACQ_REL);
+      if (!job) {
+        continue;
+      }
+      result_set_t *set = &job->set;
+      trace_begin("parse_result_text");
+      set->count = parse_result_text(set->text, set->length, job->top_k, &set->results, set->arena);
+      trace_end("parse_result_text");
+      /* Hashed here too, so the loop only compares them. */
+      result_set_hash(set);
+
+      parse_job_t *old = __atomic_exchange_n(&slot->parsed, job, __ATOMIC_ACQ_REL);
+      if (old) {
+        /* Parsed but superseded before the loop got to it. */
+        parser_job_free(old);
+      }
+      published = 1;
+    }
+    if (published) {
+      wake(parser.ready_fd);
+    }
+  }
+  return NULL;
+}
+
+/* @brief Called by the loop when the parser thread published jobs. */
+static void handle_ready(uint32_t events, void *data) {
+  uint64_t count;
+  if (read(parser.ready_fd, &count, sizeof(count)) == sizeof(count)) {
+    parser.ready(events, parser.ready_data);
+  }
+}
+
+int32_t parser_add_slot(parse_slot_t *slot) {
+  if (parser.slot_count == MAX_BACKENDS) {
+    return -1;
+  }
+  slot->pending = NULL;
+  slot->parsed = NULL;
+  parser.slots[parser.slot_count++] = slot;
+  return 0;
+}
+
+int32_t parser_start(loop_callback_t ready, void *data) {
+  parser.ready = ready;
+  parser.ready_data = data;
+  parser.quit = 0;
+
+  parser.work_fd = eventfd(0, EFD_CLOEXEC);
+  parser.ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (parser.work_fd == -1 || parser.ready_fd == -1) {
+    fprintf(stderr, "Couldn't create the parser eventfds: %s\n", strerror(errno));
+    return -1;
+  }
+  if (loop_add(parser.ready_fd, EPOLLIN, handle_ready, NULL)) {
+    return -1;
+  }
+  if (pthread_create(&parser.thread, NULL, parser_thread, NULL)) {
+    fprintf(stderr, "Couldn't start the parser thread.\n");
+    return -1;
+  }
+  parser.running = 1;
+  return 0;
+}
+
+void parser_stop(void) {
+  if (parser.running) {
+    __atomic_store_n(&parser.quit, 1, __ATOMIC_RELEASE);
+    wake(parser.work_fd);
+    pthread_join(parser.thread, NULL);
+    parser.running = 0;
+  }
+
+  uint32_t i;
+  for (i = 0; i < parser.slot_count; i++) {
+    if (parser.slots[i]->pending) {
+      parser_job_free(parser.slots[i]->pending);
+    }
+    if (parser.slots[i]->parsed) {
+      parser_job_free(parser.slots[i]->parsed);
+    }
+    parser.slots[i]->pending = parser.slots[i]->parsed = NULL;
+  }
+  parser.slot_count = 0;
+
+  if (parser.ready_fd != -1) {
+    loop_remove(parser.ready_fd);
+    close(parser.ready_fd);
+    parser.ready_fd = -1;
+  }
+  if (parser.work_fd != -1) {
+    close(parser.work_fd);
+    parser.work_fd = -1;
+  }
+}
+
+parse_job_t *parser_job_new(const char *text, size_t length, uint32_t generation) {
+  /* Sized for the job, the text and the results of a typical line. */
+  arena_t *arena = arena_new(sizeof(parse_job_t) + length + 1 + length / 2);
+  if (!arena) {
+    return NULL;
+  }
+  parse_job_t *job = arena_alloc(arena, sizeof(parse_job_t));
+  char *copy = arena_alloc(arena, length + 1);
+  if (!job || !copy) {
+    arena_free(arena);
+    return NULL;
+  }
+  memset(job, 0, sizeof(parse_job_t));
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  job->set.arena = arena;
+  job->set.text = copy;
+  job->set.length = length;
+  job->generation = generation;
+  return job;
+}
+
+void parser_job_free(parse_job_t *job) {
+  /* The job lives in its own arena. */
+  arena_free(job->set.arena);
+}
+
+void parser_submit(parse_slot_t *slot, parse_job_t *job) {
+  parse_job_t *old = __atomic_exchange_n(&slot->pending, job, __ATOMIC_ACQ_REL);
+  if (old) {
+    /* The parser thread hadn't started on it, no point anymore. */
+    parser_job_free(old);
+  }
+  wake(parser.work_fd);
+}
+
+void parser_publish(parse_slot_t *slot, parse_job_t *job) {
+  parse_job_t *old = __atomic_exchange_n(&slot->parsed, job, __ATOMIC_ACQ_REL);
+  if (old) {
+    parser_job_free(old);
+  }
+  wake(parser.ready_fd);
+}
+
+parse_job_t *parser_take(parse_slot_t *slot) {
+  return __atomic_exchange_n(&slot->parsed, NULL, __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,233 @@
+/** @file plugin.c
+ *
+ *  @brief This file contains the loading of in process backends and the
+ *         functions they build their answers with.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "plugin.h"
+
+/* @brief Marks a field that was left out. */
+#define NO_FIELD          UINT32_MAX
+
+/* @brief The text and results an answer starts out with room for. */
+#define ANSWER_TEXT_SIZE  4096
+#define ANSWER_RESULTS    64
+
+/* @brief The fields are kept as offsets into text, which moves as it grows,
+ *        and only turned into results once the answer is sent.
+ */
+struct lighthouse_answer {
+  parse_slot_t *slot;
+  uint32_t generation;
+  char *text;
+  size_t length;
+  size_t size;
+  uint32_t *fields;         /* Text, action and desc of every result. */
+  uint32_t count;
+  uint32_t max;
+};
+
+static lighthouse_answer_t *answer_new(void *host, uint32_t generation) {
+  lighthouse_answer_t *answer = calloc(1, sizeof(lighthouse_answer_t));
+  if (!answer) {
+    return NULL;
+  }
+  answer->slot = host;
+  answer->generation = generation;
+  answer->size = ANSWER_TEXT_SIZE;
+  answer->max = ANSWER_RESULTS;
+  answer->text = malloc(answer->size);
+  answer->fields = malloc(answer->max * 3 * sizeof(uint32_t));
+  if (!answer->text || !answer->fields) {
+    free(answer->text);
+    free(answer->fields);
+    free(answer);
+    return NULL;
+  }
+  answer->text[0] = '\0';
+  return answer;
+}
+
+static void answer_drop(lighthouse_answer_t *answer) {
+  if (!answer) {
+    return;
+  }
+  free(answer->text);
+  free(answer->fields);
+  free(answer);
+}
+
+/* @brief Appends a field (and its null byte) to the text of an answer.
+ *
+ * @param answer The answer.
+ * @param field The field, NULL is taken as "".
+ * @param optional Set if an empty field is left out.
+ * @param offset A reference to be populated with where it went.
+ * @return 0 on success and -1 on failure.
+ */
+static int32_t append_field(lighthouse_answer_t *answer, const char *field, int32_t optional, uint32_t *offset) {
+  if (!field) {
+    field = "";
+  }
+  if (optional && !*field) {
+    *offset = NO_FIELD;
+    return 0;
+  }
+  size_t length = strlen(field);
+  /* Always keep a null byte past the end, the text is used as a string. */
+  if (answer->length + length + 2 > answer->size) {
+    size_t size = answer->size;
+    while (answer->length + length + 2 > size) {
+      size *= 2;
+    }
+    if (size >= NO_FIELD) {
+      return -1;
+    }
+    char *text = realloc(answer->text, size);
+    if (!text) {
+      return -1;
+    }
+    answer->text = text;
+    answer->size = size;
+  }
+  *offset = answer->length;
+  memcpy(answer->text + answer->length, field, length + 1);
+  answer->length += length + 1;
+  answer->text[answer->length] = '\0';
+  return 0;
+}
+
+static int32_t answer_add(lighthouse_answer_t *answer, const char *text, const char *action, const char *desc) {
+  if (answer->count == answer->max) {
+    uint32_t *fields = realloc(answer->fields, answer->max * 2 * 3 * sizeof(uint32_t));
+    if (!fields) {
+      return -1;
+    }
+    answer->fields = fields;
+    answer->max *= 2;
+  }
+  uint32_t *field = &answer->fields[answer->count * 3];
+  size_t length = answer->length;
+  if (append_field(answer, text, 0, &field[0])
+      || append_field(answer, action, 1, &field[1])
+      || append_field(answer, desc, 1, &field[2])) {
+    /* Take back whatever made it in. */
+    answer->length = length;
+    answer->text[length] = '\0';
+    return -1;
+  }
+  answer->count++;
+  return 0;
+}
+
+static void answer_send(lighthouse_answer_t *answer) {
+  /* The job and the results share an arena, which takes the text over. */
+  arena_t *arena = arena_new(sizeof(parse_job_t) + (answer->count + 1) * sizeof(result_t));
+  if (!arena) {
+    answer_drop(answer);
+    return;
+  }
+  parse_job_t *job = arena_alloc(arena, sizeof(parse_job_t));
+  result_t *results = arena_alloc(arena, (answer->count + 1) * sizeof(result_t));
+  if (!job || !results || arena_adopt(arena, answer->text)) {
+    arena_free(arena);
+    answer_drop(answer);
+    return;
+  }
+
+  uint32_t i;
+  for (i = 0; i < answer->count; i++) {
+    uint32_t *field = &answer->fields[i * 3];
+    results[i].text = answer->text + field[0];
+    results[i].action = field[1] == NO_FIELD ? NULL : answer->text + field[1];
+    results[i].desc = field[2] == NO_FIELD ? NULL : answer->text + field[2];
+    results[i].score = 0;
+  }
+  memset(&results[answer->count], 0, sizeof(result_t));
+
+  memset(job, 0, sizeof(parse_job_t));
+  job->set.arena = arena;
+  job->set.results = results;
+  job->set.count = answer->count;
+  job->set.text = answer->text;
+  job->set.length = answer->length;
+  job->generation = answer->generation;
+  parser_publish(answer->slot, job);
+
+  free(answer->fields);
+  free(answer);
+}
+
+static const lighthouse_host_t host = {
+  .abi_version = LIGHTHOUSE_PLUGIN_ABI_VERSION,
+  .answer_new = answer_new,
+  .answer_add = answer_add,
+  .answer_send = answer_send,
+  .answer_drop = answer_drop
+};
+
+int32_t plugin_load(plugin_t *plugin, char **argv, parse_slot_t *slot) {
+  memset(plugin, 0, sizeof(plugin_t));
+  void *handle = dlopen(argv[0], RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    fprintf(stderr, "Couldn't load %s: %s\n", argv[0], dlerror());
+    return -1;
+  }
+
+  const lighthouse_plugin_t *exported = dlsym(handle, "lighthouse_plugin");
+  if (!exported || !exported->query) {
+    fprintf(stderr, "%s doesn't export a lighthouse_plugin.\n", argv[0]);
+    dlclose(handle);
+    return -1;
+  }
+  if (exported->abi_version != LIGHTHOUSE_PLUGIN_ABI_VERSION) {
+    fprintf(stderr, "%s was built for plugin ABI %u, not %u.\n", argv[0], exported->abi_version, LIGHTHOUSE_PLUGIN_ABI_VERSION);
+    dlclose(handle);
+    return -1;
+  }
+
+  int32_t argc = 0;
+  while (argv[argc]) {
+    argc++;
+  }
+  void *state = NULL;
+  if (exported->init && exported->init(&host, slot, argc, argv, &state)) {
+    fprintf(stderr, "%s failed to start.\n", argv[0]);
+    dlclose(handle);
+    return -1;
+  }
+
+  plugin->handle = handle;
+  plugin->plugin = exported;
+  plugin->state = state;
+  return 0;
+}
+
+void plugin_unload(plugin_t *plugin) {
+  if (!plugin->handle) {
+    return;
+  }
+  if (plugin->plugin->free) {
+    plugin->plugin->free(plugin->state);
+  }
+  dlclose(plugin->handle);
+  memset(plugin, 0, sizeof(plugin_t));
+}
+
+void plugin_query(plugin_t *plugin, uint32_t generation, const char *query) {
+  plugin->plugin->query(plugin->state, generation, query);
+}
+
+void plugin_cancel(plugin_t *plugin, uint32_t generation) {
+  if (plugin->plugin->cancel) {
+    plugin->plugin->cancel(plugin->state, generation);
+  }
+}
@@ -0,0 +1,169 @@
+/** @file reader.c
+ *
+ *  @brief This file contains a growable buffer used to frame the records
+ *         sent back by the spawned user defined process.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "reader.h"
+
+#define min(a,b) ((a) < (b) ? (a) : (b))
+#define max(a,b) ((a) > (b) ? (a) : (b))
+
+/* @brief Size of the length in front of a frame. */
+#define FRAME_HEADER_SIZE sizeof(uint32_t)
+
+int32_t reader_init(reader_t *reader, size_t max_size) {
+  memset(reader, 0, sizeof(reader_t));
+  reader->max_size = max_size;
+  reader->size = min(RESULT_BUF_SIZE, max_size);
+  reader->buf = malloc(reader->size);
+  if (!reader->buf) {
+    return -1;
+  }
+  return 0;
+}
+
+void reader_free(reader_t *reader) {
+  free(reader->buf);
+  memset(reader, 0, sizeof(reader_t));
+}
+
+ssize_t reader_fill(reader_t *reader, int32_t fd) {
+  /* Drop the records that were already handed out, only the beginning of
+   * a partial record is left to move. */
+  if (reader->start) {
+    memmove(reader->buf, reader->buf + reader->start, reader->length - reader->start);
+    reader->length -= reader->start;
+    reader->scanned -= reader->start;
+    reader->start = 0;
+  }
+
+  if (reader->length == reader->size) {
+    if (reader->size >= reader->max_size) {
+      /* The record will never fit, throw away what we have of it and
+       * skip the rest of it up to the next newline. */
+      if (!reader->overflow) {
+        fprintf(stderr, "Result larger than %zu bytes, dropping it.\n", reader->max_size);
+      }
+      reader->overflow = 1;
+      reader->length = 0;
+      reader->scanned = 0;
+    } else {
+      size_t size = min(reader->size * 2, reader->max_size);
+      char *buf = realloc(reader->buf, size);
+      if (!buf) {
+        fprintf(stderr, "Couldn't grow the result buffer to %zu bytes.\n", size);
+        return -1;
+      }
+      reader->buf = buf;
+      reader->size = size;
+    }
+  }
+
+  ssize_t ret;
+  do {
+    ret = read(fd, reader->buf + reader->length, reader->size - reader->length);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret > 0) {
+    reader->length += ret;
+  }
+  return ret;
+}
+
+char *reader_next(reader_t *reader, size_t *length) {
+  while (reader->scanned < reader->length) {
+    char *newline = memchr(reader->buf + reader->scanned, '\n', reader->length - reader->scanned);
+    if (!newline) {
+      /* Remember where we stopped so these bytes are never searched again. */
+      reader->scanned = reader->length;
+      return NULL;
+    }
+
+    char *record = reader->buf + reader->start;
+    *newline = '\0';
+    reader->start = reader->scanned = newline - reader->buf + 1;
+
+    if (reader->overflow) {
+      /* This was the tail of a dropped record. */
+      reader->overflow = 0;
+      continue;
+    }
+
+    *length = newline - record;
+    return record;
+  }
+  return NULL;
+}
+
+char *reader_next_frame(reader_t *reader, size_t *length) {
+  while (1) {
+    if (reader->skip) {
+      /* Still dropping a frame that was too large. */
+      size_t dropped = min(reader->skip, reader->length - reader->start);
+      reader->start += dropped;
+      reader->skip -= dropped;
+      reader->scanned = reader->start;
+      if (reader->skip) {
+        return NULL;
+      }
+    }
+
+    if (reader->length - reader->start < FRAME_HEADER_SIZE) {
+      return NULL;
+    }
+    uint32_t frame_length;
+    memcpy(&frame_length, reader->buf + reader->start, FRAME_HEADER_SIZE);
+    if (frame_length > reader->max_size - FRAME_HEADER_SIZE) {
+      fprintf(stderr, "Result larger than %zu bytes, dropping it.\n", reader->max_size);
+      reader->start += FRAME_HEADER_SIZE;
+      reader->scanned = reader->start;
+      reader->skip = frame_length;
+      continue;
+    }
+    if (reader->length - reader->start - FRAME_HEADER_SIZE < frame_length) {
+      return NULL;
+    }
+
+    char *frame = reader->buf + reader->start + FRAME_HEADER_SIZE;
+    reader->start += FRAME_HEADER_SIZE + frame_length;
+    reader->scanned = reader->start;
+    *length = frame_length;
+    return frame;
+  }
+}
+
+char *reader_rest(reader_t *reader, size_t *length) {
+  if (reader->overflow || reader->start == reader->length) {
+    return NULL;
+  }
+  char *rest = reader->buf + reader->start;
+  *length = reader->length - reader->start;
+  reader->start = reader->scanned = reader->length;
+  return rest;
+}
+
+char *reader_take(reader_t *reader) {
+  size_t left = reader->length - reader->start;
+  size_t size = max(min(RESULT_BUF_SIZE, reader->max_size), left);
+  char *buf = malloc(size);
+  if (!buf) {
+    return NULL;
+  }
+  memcpy(buf, reader->buf + reader->start, left);
+
+  char *taken = reader->buf;
+  reader->buf = buf;
+  reader->size = size;
+  reader->length = left;
+  reader->scanned = reader->scanned > reader->start ? reader->scanned - reader->start : 0;
+  reader->start = 0;
+  return taken;
+}
@@ -0,0 +1,106 @@
+/** @file trace.c
+ *
+ *  @brief This file contains the tracer that timestamps every stage between
+ *         a key and the pixels it changes, only built with -DTRACE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "trace.h"
+
+#ifdef TRACE
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct {
+  FILE *file;
+  pthread_mutex_t lock;     /* The parser thread traces too. */
+  int32_t events;
+} tracer = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* @brief Microseconds on the monotonic clock, which is what the format uses. */
+static double trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000000 + ts.tv_nsec / 1000.0;
+}
+
+/* @brief Writes a string as a JSON string. */
+static void write_string(const char *text) {
+  fputc('"', tracer.file);
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') {
+      fputc('\\', tracer.file);
+      fputc(*text, tracer.file);
+    } else if ((unsigned char)*text < 0x20) {
+      fprintf(tracer.file, "\\u%04x", (unsigned char)*text);
+    } else {
+      fputc(*text, tracer.file);
+    }
+  }
+  fputc('"', tracer.file);
+}
+
+/* @brief Writes an event, taking the timestamp under the lock so events of
+ *        a thread are written in order.
+ */
+static void write_event(char phase, const char *name, const char *detail) {
+  pthread_mutex_lock(&tracer.lock);
+  if (tracer.file) {
+    fprintf(tracer.file, "%s\n{\"name\":", tracer.events++ ? "," : "");
+    write_string(name);
+    fprintf(tracer.file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld",
+        phase, trace_now(), (int)getpid(), (long)syscall(SYS_gettid));
+    if (phase == 'i') {
+      fprintf(tracer.file, ",\"s\":\"t\"");
+    }
+    if (detail) {
+      fprintf(tracer.file, ",\"args\":{\"detail\":");
+      write_string(detail);
+      fputc('}', tracer.file);
+    }
+    fputc('}', tracer.file);
+  }
+  pthread_mutex_unlock(&tracer.lock);
+}
+
+int32_t trace_open(const char *file) {
+  tracer.file = fopen(file, "w");
+  if (!tracer.file) {
+    fprintf(stderr, "Couldn't open the trace file %s.\n", file);
+    return -1;
+  }
+  tracer.events = 0;
+  fputc('[', tracer.file);
+  return 0;
+}
+
+void trace_close(void) {
+  pthread_mutex_lock(&tracer.lock);
+  if (tracer.file) {
+    fprintf(tracer.file, "\n]\n");
+    fclose(tracer.file);
+    tracer.file = NULL;
+  }
+  pthread_mutex_unlock(&tracer.lock);
+}
+
+void trace_begin(const char *name) {
+  write_event('B', name, NULL);
+}
+
+void trace_end(const char *name) {
+  write_event('E', name, NULL);
+}
+
+void trace_instant(const char *name, const char *detail) {
+  write_event('i', name, detail);
+}
+
+#endif
@@ -0,0 +1,89 @@
+/** @file writer.c
+ *
+ *  @brief This file contains the buffer queries are written to the spawned
+ *         user defined process through, without ever waiting on it.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "writer.h"
+
+/* @brief Size of the buffer to start with, it holds most queries. */
+#define WRITER_BUF_SIZE   256
+
+int32_t writer_init(writer_t *writer) {
+  memset(writer, 0, sizeof(writer_t));
+  writer->size = WRITER_BUF_SIZE;
+  writer->buf = malloc(writer->size);
+  if (!writer->buf) {
+    return -1;
+  }
+  return 0;
+}
+
+void writer_free(writer_t *writer) {
+  free(writer->buf);
+  memset(writer, 0, sizeof(writer_t));
+}
+
+int32_t writer_printf(writer_t *writer, const char *format, ...) {
+  /* Drop what was written already, only the rest of a message is left. */
+  if (writer->start) {
+    memmove(writer->buf, writer->buf + writer->start, writer->length - writer->start);
+    writer->length -= writer->start;
+    writer->start = 0;
+  }
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(writer->buf + writer->length, writer->size - writer->length, format, args);
+  va_end(args);
+  if (length < 0) {
+    return -1;
+  }
+
+  if ((size_t)length >= writer->size - writer->length) {
+    size_t size = writer->size;
+    while ((size_t)length >= size - writer->length) {
+      size *= 2;
+    }
+    char *buf = realloc(writer->buf, size);
+    if (!buf) {
+      fprintf(stderr, "Couldn't grow the query buffer to %zu bytes.\n", size);
+      return -1;
+    }
+    writer->buf = buf;
+    writer->size = size;
+
+    va_start(args, format);
+    vsnprintf(writer->buf + writer->length, writer->size - writer->length, format, args);
+    va_end(args);
+  }
+  writer->length += length;
+  return 0;
+}
+
+ssize_t writer_flush(writer_t *writer, int32_t fd) {
+  while (writer->start < writer->length) {
+    ssize_t ret = write(fd, writer->buf + writer->start, writer->length - writer->start);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return -1;
+    }
+    writer->start += ret;
+  }
+  if (writer->start == writer->length) {
+    writer->start = writer->length = 0;
+  }
+  return writer->length - writer->start;
+}